@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <utility>
+#include "dynamic_bitset.h"
+
+namespace ccnt {
+    // A blocked Bloom filter over hash codes. The HASHES bits of a hash code
+    // all fall in one 64-bit word, chosen by its high half, so a test touches
+    // a single cache line. Bits can't be cleared one at a time; a filter that
+    // sees removals has to be rebuilt with reset.
+    template<typename TAllocator = std::allocator<Bitset<64>>>
+    class BloomFilter {
+    public:
+        static constexpr std::uint32_t HASHES = 4;
+
+    public:
+        explicit BloomFilter(std::uint32_t nbits = 64) : m_bits(nbits), m_words(0) {
+            reset(nbits);
+        }
+
+        BloomFilter(BloomFilter&& bloom_filter) : m_bits(std::move(bloom_filter.m_bits)), m_words(bloom_filter.m_words) {
+            bloom_filter.m_words = 0;
+        }
+
+        ~BloomFilter() = default;
+
+        inline void insert(std::uint64_t hash_code) {
+            std::uint32_t first = word(hash_code) * 64;
+            for (std::uint32_t i = 0; i < HASHES; i++) {
+                m_bits.set_bit(first + ((hash_code >> (i * 6)) & 63));
+            }
+        }
+
+        // False means the hash code was never inserted; true may be a false
+        // positive.
+        inline bool contains(std::uint64_t hash_code) const {
+            std::uint32_t first = word(hash_code) * 64;
+            for (std::uint32_t i = 0; i < HASHES; i++) {
+                if (!m_bits[first + ((hash_code >> (i * 6)) & 63)]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Clears the filter and resizes it to nbits, rounded down to whole
+        // words.
+        inline void reset(std::uint32_t nbits) {
+            m_words = std::max(nbits / 64, 1u);
+            m_bits.resize(m_words * 64);
+            m_bits.unset_all_bits();
+        }
+
+        inline void clear() {
+            m_bits.unset_all_bits();
+        }
+
+        inline std::uint32_t get_size() const {
+            return m_words * 64;
+        }
+
+        BloomFilter(const BloomFilter&) = delete;
+        BloomFilter& operator = (const BloomFilter&) = delete;
+
+    private:
+        inline std::uint32_t word(std::uint64_t hash_code) const {
+            return static_cast<std::uint32_t>(((hash_code >> 32) * m_words) >> 32);
+        }
+
+    private:
+        DynamicBitset<64, TAllocator> m_bits;
+        std::uint32_t m_words;
+    };
+}
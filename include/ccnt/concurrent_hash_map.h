@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <bit>
+#include "hash_map.h"
+
+namespace ccnt {
+    // A HashMap split into TShards independently locked shards. The shard a
+    // key lives in is picked from the bits just below the top 7 of its 64-bit
+    // hash, which a shard with 64-bit codes uses as tags, while the shard
+    // itself indexes with the low bits, so all three stay well distributed.
+    // Readers of a shard share its lock and writers take it exclusively.
+    // Values are handed out by copy or through a callback run under the lock,
+    // never by reference.
+    template<typename TKey, typename TValue, std::uint32_t TShards = 64, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class ConcurrentHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Map   = HashMap<TKey, TValue, THashIndex, TAllocator, THash, THashCode>;
+        using Node  = typename Map::Node;
+
+        static_assert(std::has_single_bit(TShards), "ConcurrentHashMap requires a power of two shard count");
+
+    public:
+        ConcurrentHashMap() = default;
+
+        explicit ConcurrentHashMap(std::uint32_t capacity) {
+            for (Shard& shard : m_shards) {
+                shard.map = Map(capacity / TShards);
+            }
+        }
+
+        ~ConcurrentHashMap() = default;
+
+        inline bool find(const TKey& key, TValue& value) const {
+            return find_value(key, value);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool find(const TLookup& key, TValue& value) const {
+            return find_value(key, value);
+        }
+
+        // Calls function with the node under the shard's shared lock.
+        template<typename TFunction>
+        inline bool visit(const TKey& key, TFunction&& function) const {
+            const Shard& shard = get_shard(key);
+            std::shared_lock lock(shard.mutex);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.cend()) {
+                return false;
+            }
+            function(*it);
+
+            return true;
+        }
+
+        inline bool contains(const TKey& key) const {
+            const Shard& shard = get_shard(key);
+            std::shared_lock lock(shard.mutex);
+
+            return shard.map.contains(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            const Shard& shard = get_shard(key);
+            std::shared_lock lock(shard.mutex);
+
+            return shard.map.contains(key);
+        }
+
+        // Inserts only when the key is missing and returns whether it did.
+        template<typename... TArgs>
+        inline bool emplace(const TKey& key, TArgs&&... args) {
+            Shard& shard = get_shard(key);
+            std::unique_lock lock(shard.mutex);
+
+            return shard.map.try_emplace(key, std::forward<TArgs>(args)...).second;
+        }
+
+        template<typename TArg>
+        inline bool insert_or_assign(const TKey& key, TArg&& value) {
+            Shard& shard = get_shard(key);
+            std::unique_lock lock(shard.mutex);
+
+            return shard.map.insert_or_assign(key, std::forward<TArg>(value)).second;
+        }
+
+        inline bool remove(const TKey& key) {
+            return remove_key(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool remove(const TLookup& key) {
+            return remove_key(key);
+        }
+
+        // Visits every node, holding one shard's shared lock at a time. Nodes
+        // inserted or removed in other shards meanwhile may or may not be seen.
+        template<typename TFunction>
+        inline void for_each(TFunction&& function) const {
+            for (const Shard& shard : m_shards) {
+                std::shared_lock lock(shard.mutex);
+                for (const Node& node : shard.map) {
+                    function(node);
+                }
+            }
+        }
+
+        inline void clear() {
+            for (Shard& shard : m_shards) {
+                std::unique_lock lock(shard.mutex);
+                shard.map.clear();
+            }
+        }
+
+        inline std::uint32_t get_count() const {
+            std::uint32_t count = 0;
+            for (const Shard& shard : m_shards) {
+                std::shared_lock lock(shard.mutex);
+                count += shard.map.get_count();
+            }
+            return count;
+        }
+
+        static constexpr std::uint32_t get_shard_count() {
+            return TShards;
+        }
+
+        ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+        ConcurrentHashMap& operator = (const ConcurrentHashMap&) = delete;
+
+    private:
+        // Each shard sits on its own cache line so that locking one doesn't
+        // invalidate its neighbours.
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            Map map;
+        };
+
+        static constexpr std::uint32_t shard_index(std::uint64_t hash_code) {
+            if constexpr (TShards == 1) {
+                return 0;
+            }
+            else {
+                return static_cast<std::uint32_t>((hash_code << 7) >> (64 - std::countr_zero(TShards)));
+            }
+        }
+
+        template<typename TLookup>
+        inline Shard& get_shard(const TLookup& key) {
+            return m_shards[shard_index(THash::hash_code(key))];
+        }
+
+        template<typename TLookup>
+        inline const Shard& get_shard(const TLookup& key) const {
+            return m_shards[shard_index(THash::hash_code(key))];
+        }
+
+        template<typename TLookup>
+        inline bool find_value(const TLookup& key, TValue& value) const {
+            const Shard& shard = get_shard(key);
+            std::shared_lock lock(shard.mutex);
+
+            auto it = shard.map.find(key);
+            if (it == shard.map.cend()) {
+                return false;
+            }
+            value = it->get_value();
+
+            return true;
+        }
+
+        // Hashes once, outside the lock, for both the shard and the probe.
+        template<typename TLookup>
+        inline bool remove_key(const TLookup& key) {
+            auto hash_code = THash::hash_code(key);
+            Shard& shard = m_shards[shard_index(hash_code)];
+            std::unique_lock lock(shard.mutex);
+
+            return shard.map.erase_hashed(static_cast<THashCode>(hash_code), key);
+        }
+
+    private:
+        Shard m_shards[TShards];
+    };
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+#include <utility>
+#include <assert.h>
+#include "string_interner.h"
+
+namespace ccnt {
+    // A StringInterner split into TShards independently locked shards, each
+    // with its own map and arena, picked from the top bits of the string's
+    // hash. Strings already interned are found under the shard's shared lock.
+    // The low bits of a handle name its shard, so handles stay unique, but
+    // unlike StringInterner's they are not dense.
+    //
+    // Resolving a handle takes no lock: every shard keeps its views in
+    // segments that double in size and are never moved, so a reader never
+    // sees one being reallocated. The handle must have reached the reader
+    // through the intern() that returned it or some other synchronization.
+    template<std::uint32_t TShards = 16, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<char>>
+    class ConcurrentStringInterner {
+    public:
+        using Handle = std::uint32_t;
+        using Map    = typename StringInterner<THashIndex, TAllocator>::Map;
+
+        static_assert(std::has_single_bit(TShards), "ConcurrentStringInterner requires a power of two shard count");
+
+    private:
+        static constexpr std::uint32_t SHARD_BITS = std::countr_zero(TShards);
+        static constexpr std::uint32_t FIRST_SEGMENT = 64;
+        static constexpr std::uint32_t SEGMENTS = 33 - SHARD_BITS - std::countr_zero(FIRST_SEGMENT);
+
+    public:
+        ConcurrentStringInterner() = default;
+
+        ~ConcurrentStringInterner() = default;
+
+        inline Handle intern(std::string_view string) {
+            std::uint32_t shard_index = get_shard_index(string);
+            Shard& shard = m_shards[shard_index];
+            {
+                std::shared_lock lock(shard.mutex);
+                auto it = std::as_const(shard.map).find(string);
+                if (it != shard.map.cend()) {
+                    return (*it).get_value();
+                }
+            }
+            std::unique_lock lock(shard.mutex);
+            auto it = shard.map.try_emplace_with(string, [&](std::string_view key) {
+                std::uint32_t index = shard.count++;
+                assert(index <= (~0u >> SHARD_BITS));
+
+                auto [segment, offset] = locate(index);
+                if (offset == 0) {
+                    shard.segments[segment].reset(new std::string_view[static_cast<std::size_t>(FIRST_SEGMENT) << segment]);
+                }
+                std::string_view stored = shard.arena.store(key);
+                shard.segments[segment][offset] = stored;
+
+                return stored;
+            }, (shard.count << SHARD_BITS) | shard_index).first;
+
+            return (*it).get_value();
+        }
+
+        inline bool find(std::string_view string, Handle& handle) const {
+            const Shard& shard = m_shards[get_shard_index(string)];
+            std::shared_lock lock(shard.mutex);
+
+            auto it = shard.map.find(string);
+            if (it == shard.map.cend()) {
+                return false;
+            }
+            handle = (*it).get_value();
+
+            return true;
+        }
+
+        inline bool contains(std::string_view string) const {
+            const Shard& shard = m_shards[get_shard_index(string)];
+            std::shared_lock lock(shard.mutex);
+
+            return shard.map.contains(string);
+        }
+
+        inline std::string_view get_string(Handle handle) const {
+            auto [segment, offset] = locate(handle >> SHARD_BITS);
+            return m_shards[handle & (TShards - 1)].segments[segment][offset];
+        }
+
+        inline std::string_view operator [] (Handle handle) const {
+            return get_string(handle);
+        }
+
+        inline std::uint32_t get_count() const {
+            std::uint32_t count = 0;
+            for (const Shard& shard : m_shards) {
+                std::shared_lock lock(shard.mutex);
+                count += shard.count;
+            }
+            return count;
+        }
+
+        static constexpr std::uint32_t get_shard_count() {
+            return TShards;
+        }
+
+        ConcurrentStringInterner(const ConcurrentStringInterner&) = delete;
+        ConcurrentStringInterner& operator = (const ConcurrentStringInterner&) = delete;
+
+    private:
+        // Each shard sits on its own cache line so that locking one doesn't
+        // invalidate its neighbours.
+        struct alignas(64) Shard {
+            mutable std::shared_mutex mutex;
+            Map map;
+            StringArena<TAllocator> arena;
+            std::uint32_t count = 0;
+            std::unique_ptr<std::string_view[]> segments[SEGMENTS];
+        };
+
+        static inline std::uint32_t get_shard_index(std::string_view string) {
+            if constexpr (TShards == 1) {
+                return 0;
+            }
+            else {
+                return static_cast<std::uint32_t>(HashCode<std::string_view>::hash_code(string) >> (64 - SHARD_BITS));
+            }
+        }
+
+        // Segment s holds FIRST_SEGMENT << s views, starting at index
+        // FIRST_SEGMENT * (2^s - 1).
+        static inline std::pair<std::uint32_t, std::uint32_t> locate(std::uint32_t index) {
+            std::uint32_t segment = std::bit_width(index / FIRST_SEGMENT + 1) - 1;
+            return { segment, index - FIRST_SEGMENT * ((1u << segment) - 1) };
+        }
+
+    private:
+        Shard m_shards[TShards];
+    };
+}
@@ -0,0 +1,251 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "hash_map.h"
+#include "bloom_filter.h"
+
+namespace ccnt {
+    // A HashMap with a Bloom filter in front of its lookups, for workloads
+    // where most lookups miss: a miss the filter rejects costs a hash and one
+    // word of the filter instead of a probe. The filter is keyed by the hash
+    // codes stored in the nodes, so it is rebuilt without hashing any key,
+    // which happens when the table grows and once removals have left enough
+    // stale bits behind.
+    template<typename TKey, typename TValue, std::uint32_t TBitsPerSlot = 8, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class FilteredHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Map   = HashMap<TKey, TValue, THashIndex, TAllocator, THash, THashCode>;
+        using Node  = typename Map::Node;
+        using Reference      = typename Map::Reference;
+        using ConstReference = typename Map::ConstReference;
+
+        using Iterator             = typename Map::Iterator;
+        using ConstIterator        = typename Map::ConstIterator;
+        using ReverseIterator      = typename Map::ReverseIterator;
+        using ConstReverseIterator = typename Map::ConstReverseIterator;
+
+    public:
+        FilteredHashMap() : m_filter(m_map.get_capacity() * TBitsPerSlot), m_filter_capacity(m_map.get_capacity()), m_removed(0) {
+        }
+
+        explicit FilteredHashMap(std::uint32_t capacity) : m_map(capacity), m_filter(m_map.get_capacity() * TBitsPerSlot), m_filter_capacity(m_map.get_capacity()), m_removed(0) {
+        }
+
+        FilteredHashMap(FilteredHashMap&& filtered_hash_map) : m_map(std::move(filtered_hash_map.m_map)), m_filter(std::move(filtered_hash_map.m_filter)), m_filter_capacity(filtered_hash_map.m_filter_capacity), m_removed(filtered_hash_map.m_removed) {
+        }
+
+        ~FilteredHashMap() = default;
+
+        template<typename... TArgs>
+        inline Reference emplace(const TKey& key, TArgs&&... args) {
+            Reference node = m_map.emplace(key, std::forward<TArgs>(args)...);
+            add(node.get_hash_code());
+
+            return node;
+        }
+
+        inline Reference insert(const TKey& key, const TValue& value) {
+            return emplace(key, value);
+        }
+
+        template<typename... TArgs>
+        inline std::pair<Iterator, bool> try_emplace(const TKey& key, TArgs&&... args) {
+            std::pair<Iterator, bool> result = m_map.try_emplace(key, std::forward<TArgs>(args)...);
+            if (result.second) {
+                add((*result.first).get_hash_code());
+            }
+            return result;
+        }
+
+        template<typename TArg>
+        inline std::pair<Iterator, bool> insert_or_assign(const TKey& key, TArg&& value) {
+            std::pair<Iterator, bool> result = m_map.insert_or_assign(key, std::forward<TArg>(value));
+            if (result.second) {
+                add((*result.first).get_hash_code());
+            }
+            return result;
+        }
+
+        inline Iterator find(const TKey& key) {
+            return find_node(key);
+        }
+
+        inline ConstIterator find(const TKey& key) const {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Iterator find(const TLookup& key) {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstIterator find(const TLookup& key) const {
+            return find_node(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return find_node(key) != m_map.cend();
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return find_node(key) != m_map.cend();
+        }
+
+        inline Reference operator [] (const TKey& key) {
+            return m_map[key];
+        }
+
+        inline ConstReference operator [] (const TKey& key) const {
+            return m_map[key];
+        }
+
+        inline void remove(const TKey& key) {
+            m_map.remove(key);
+            removed();
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            m_map.remove(key);
+            removed();
+        }
+
+        inline FilteredHashMap& operator = (FilteredHashMap&& filtered_hash_map) {
+            if (this != &filtered_hash_map) {
+                std::destroy_at(this);
+                std::construct_at(this, std::move(filtered_hash_map));
+            }
+
+            return *this;
+        }
+
+        inline void clear() {
+            m_map.clear();
+            m_filter.clear();
+            m_removed = 0;
+        }
+
+        inline void set_max_load_factor(float max_load_factor) {
+            m_map.set_max_load_factor(max_load_factor);
+            if (m_map.get_capacity() != m_filter_capacity) {
+                rebuild();
+            }
+        }
+
+        inline float get_max_load_factor() const {
+            return m_map.get_max_load_factor();
+        }
+
+        inline float get_load_factor() const {
+            return m_map.get_load_factor();
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_map.get_count();
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_map.get_capacity();
+        }
+
+        Iterator begin() {
+            return m_map.begin();
+        }
+
+        Iterator end() {
+            return m_map.end();
+        }
+
+        ConstIterator begin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator end() const {
+            return m_map.cend();
+        }
+
+        ConstIterator cbegin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator cend() const {
+            return m_map.cend();
+        }
+
+        ReverseIterator rbegin() {
+            return m_map.rbegin();
+        }
+
+        ReverseIterator rend() {
+            return m_map.rend();
+        }
+
+        ConstReverseIterator crbegin() const {
+            return m_map.crbegin();
+        }
+
+        ConstReverseIterator crend() const {
+            return m_map.crend();
+        }
+
+        FilteredHashMap(const FilteredHashMap&) = delete;
+        FilteredHashMap& operator = (const FilteredHashMap&) = delete;
+
+    private:
+        // The stored hash code feeds the table's index and tag, so it is mixed
+        // again before it picks filter bits.
+        static inline std::uint64_t filter_hash(THashCode hash_code) {
+            return hash_mix(hash_code ^ HASH_SECRET[2], HASH_SECRET[3]);
+        }
+
+        // The key is hashed once, for the filter and for the probe.
+        template<typename TLookup>
+        inline Iterator find_node(const TLookup& key) {
+            THashCode hash_code = THash::hash_code(key);
+            return m_filter.contains(filter_hash(hash_code)) ? m_map.find_hashed(hash_code, key) : m_map.end();
+        }
+
+        template<typename TLookup>
+        inline ConstIterator find_node(const TLookup& key) const {
+            THashCode hash_code = THash::hash_code(key);
+            return m_filter.contains(filter_hash(hash_code)) ? m_map.find_hashed(hash_code, key) : m_map.cend();
+        }
+
+        inline void add(THashCode hash_code) {
+            if (m_map.get_capacity() != m_filter_capacity) {
+                return rebuild();
+            }
+            m_filter.insert(filter_hash(hash_code));
+        }
+
+        // Removed keys leave their bits set. Rebuilding once a quarter of the
+        // capacity has been removed keeps the cost per removal constant.
+        inline void removed() {
+            if (++m_removed > m_filter_capacity / 4) {
+                rebuild();
+            }
+        }
+
+        inline void rebuild() {
+            m_filter_capacity = m_map.get_capacity();
+            m_filter.reset(m_filter_capacity * TBitsPerSlot);
+            for (auto&& node : m_map) {
+                m_filter.insert(filter_hash(node.get_hash_code()));
+            }
+            m_removed = 0;
+        }
+
+    private:
+        Map m_map;
+        BloomFilter<> m_filter;
+        std::uint32_t m_filter_capacity;
+        std::uint32_t m_removed;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,380 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <array>
+#include <span>
+#include <utility>
+#include <type_traits>
+#include <algorithm>
+#include <assert.h>
+#include "hash_map.h"
+
+namespace ccnt {
+    // Frozen maps place their keys with a minimal perfect hash built with the
+    // CHD algorithm. Keys are split into buckets of about four. The buckets are
+    // placed largest first, and each one searches for a displacement that
+    // sends all of its keys to free slots. A lookup hashes the key, reads the
+    // displacement of its bucket and lands on the one slot the key can be in.
+    constexpr std::uint32_t frozen_hash_bucket_count(std::uint32_t count) {
+        return count / 4 + 1;
+    }
+
+    constexpr std::uint32_t frozen_hash_bucket(std::uint64_t hash_code, std::uint32_t bucket_count) {
+        return static_cast<std::uint32_t>((hash_code >> 32) % bucket_count);
+    }
+
+    constexpr std::uint32_t frozen_hash_slot(std::uint64_t hash_code, std::uint32_t displacement, std::uint32_t count) {
+        return static_cast<std::uint32_t>(hash_mix(hash_code ^ HASH_SECRET[2], displacement ^ HASH_SECRET[3]) % count);
+    }
+
+    // The displacements a bucket tries before the build gives up. The last
+    // buckets have few free slots left, so the bound grows with the count.
+    constexpr std::uint64_t frozen_hash_max_displacements(std::uint32_t count) {
+        return static_cast<std::uint64_t>(count) * 64 + 64;
+    }
+
+    // Fills displacements, one per bucket, and the slot assigned to each key.
+    // Returns false, leaving both unspecified, if two keys share a hash code,
+    // as duplicate keys do, or a bucket runs out of displacements to try.
+    constexpr bool frozen_hash_build(const std::uint64_t* hash_codes, std::uint32_t count, std::uint32_t* displacements, std::uint32_t bucket_count, std::uint32_t* slots) {
+        std::uint32_t* bucket_starts = new std::uint32_t[bucket_count + 1]();
+        std::uint32_t* bucket_keys = new std::uint32_t[count + 1];
+        std::uint32_t* buckets = new std::uint32_t[bucket_count];
+        std::uint32_t* candidates = new std::uint32_t[count + 1];
+        bool* taken = new bool[count + 1]();
+
+        for (std::uint32_t i = 0; i < count; i++) {
+            bucket_starts[frozen_hash_bucket(hash_codes[i], bucket_count) + 1]++;
+        }
+        for (std::uint32_t i = 0; i < bucket_count; i++) {
+            bucket_starts[i + 1] += bucket_starts[i];
+            buckets[i] = i;
+        }
+        for (std::uint32_t i = 0; i < count; i++) {
+            std::uint32_t bucket = frozen_hash_bucket(hash_codes[i], bucket_count);
+            std::uint32_t position = bucket_starts[bucket]++;
+            bucket_keys[position] = i;
+        }
+        for (std::uint32_t i = bucket_count; i > 0; i--) {
+            bucket_starts[i] = bucket_starts[i - 1];
+        }
+        bucket_starts[0] = 0;
+
+        std::sort(buckets, buckets + bucket_count, [&](std::uint32_t a, std::uint32_t b) {
+            return bucket_starts[a + 1] - bucket_starts[a] > bucket_starts[b + 1] - bucket_starts[b];
+        });
+
+        bool built = true;
+        for (std::uint32_t i = 0; i < bucket_count && built; i++) {
+            std::uint32_t bucket = buckets[i];
+            std::uint32_t first = bucket_starts[bucket];
+            std::uint32_t size = bucket_starts[bucket + 1] - first;
+            displacements[bucket] = 0;
+
+            for (std::uint32_t j = 0; j < size && built; j++) {
+                for (std::uint32_t k = 0; k < j; k++) {
+                    if (hash_codes[bucket_keys[first + j]] == hash_codes[bucket_keys[first + k]]) {
+                        built = false;
+                        break;
+                    }
+                }
+            }
+
+            std::uint64_t displacement = 0;
+            for (; built && size != 0 && displacement < frozen_hash_max_displacements(count); displacement++) {
+                std::uint32_t placed = 0;
+                for (; placed < size; placed++) {
+                    std::uint32_t slot = frozen_hash_slot(hash_codes[bucket_keys[first + placed]], static_cast<std::uint32_t>(displacement), count);
+                    if (taken[slot]) {
+                        break;
+                    }
+                    taken[slot] = true;
+                    candidates[placed] = slot;
+                }
+                if (placed == size) {
+                    displacements[bucket] = static_cast<std::uint32_t>(displacement);
+                    for (std::uint32_t j = 0; j < size; j++) {
+                        slots[bucket_keys[first + j]] = candidates[j];
+                    }
+                    break;
+                }
+                for (std::uint32_t j = 0; j < placed; j++) {
+                    taken[candidates[j]] = false;
+                }
+            }
+            if (displacement == frozen_hash_max_displacements(count)) {
+                built = false;
+            }
+        }
+
+        delete[] bucket_starts;
+        delete[] bucket_keys;
+        delete[] buckets;
+        delete[] candidates;
+        delete[] taken;
+
+        return built;
+    }
+
+    // An immutable map built once from a HashMap or from key and value spans.
+    // Every lookup is a single probe into a table with no empty slots, and
+    // nodes carry no hash code. Keys must be distinct; when they are not the
+    // map is left empty and is_valid() returns false.
+    template<typename TKey, typename TValue, typename THash = HashCode<TKey>, typename TAllocator = std::allocator<HashNode<TKey, TValue, void>>>
+    class FrozenHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Node  = HashNode<TKey, TValue, void>;
+
+    public:
+        FrozenHashMap(std::span<const TKey> keys, std::span<const TValue> values) : m_count(static_cast<std::uint32_t>(keys.size())), m_bucket_count(frozen_hash_bucket_count(m_count)) {
+            assert(values.size() >= keys.size());
+            allocate();
+
+            std::uint64_t* hash_codes = new std::uint64_t[m_count + 1];
+            std::uint32_t* slots = new std::uint32_t[m_count + 1];
+            for (std::uint32_t i = 0; i < m_count; i++) {
+                hash_codes[i] = THash::hash_code(keys[i]);
+            }
+            if (frozen_hash_build(hash_codes, m_count, m_displacements, m_bucket_count, slots)) {
+                for (std::uint32_t i = 0; i < m_count; i++) {
+                    std::construct_at(m_data + slots[i], keys[i], values[i]);
+                }
+            }
+            else {
+                fail();
+            }
+
+            delete[] hash_codes;
+            delete[] slots;
+        }
+
+        template<typename THashIndex, typename TMapAllocator, typename THashCode>
+        explicit FrozenHashMap(const HashMap<TKey, TValue, THashIndex, TMapAllocator, THash, THashCode>& map) : m_count(map.get_count()), m_bucket_count(frozen_hash_bucket_count(m_count)) {
+            allocate();
+
+            std::uint64_t* hash_codes = new std::uint64_t[m_count + 1];
+            std::uint32_t* slots = new std::uint32_t[m_count + 1];
+            std::uint32_t i = 0;
+            for (const auto& node : map) {
+                hash_codes[i++] = THash::hash_code(node.get_key());
+            }
+            if (frozen_hash_build(hash_codes, m_count, m_displacements, m_bucket_count, slots)) {
+                i = 0;
+                for (const auto& node : map) {
+                    std::construct_at(m_data + slots[i++], node.get_key(), node.get_value());
+                }
+            }
+            else {
+                fail();
+            }
+
+            delete[] hash_codes;
+            delete[] slots;
+        }
+
+        FrozenHashMap(FrozenHashMap&& frozen_hash_map) : m_data(frozen_hash_map.m_data), m_displacements(frozen_hash_map.m_displacements), m_count(frozen_hash_map.m_count), m_bucket_count(frozen_hash_map.m_bucket_count), m_valid(frozen_hash_map.m_valid), m_allocator(frozen_hash_map.m_allocator), m_displacement_allocator(frozen_hash_map.m_displacement_allocator) {
+            frozen_hash_map.m_data = nullptr;
+            frozen_hash_map.m_displacements = nullptr;
+            frozen_hash_map.m_count = 0;
+        }
+
+        ~FrozenHashMap() {
+            if (m_data != nullptr) {
+                std::destroy(m_data, m_data + m_count);
+                m_allocator.deallocate(m_data, m_count + 1);
+                m_displacement_allocator.deallocate(m_displacements, m_bucket_count);
+            }
+        }
+
+        inline const Node* find(const TKey& key) const {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node* find(const TLookup& key) const {
+            return find_node(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        inline const Node& operator [] (const TKey& key) const {
+            const Node* node = find_node(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node& operator [] (const TLookup& key) const {
+            const Node* node = find_node(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_count;
+        }
+
+        // False if the map was built from keys that are not distinct.
+        inline bool is_valid() const {
+            return m_valid;
+        }
+
+        const Node* begin() const {
+            return m_data;
+        }
+
+        const Node* end() const {
+            return m_data + m_count;
+        }
+
+        FrozenHashMap(const FrozenHashMap&) = delete;
+        FrozenHashMap& operator = (const FrozenHashMap&) = delete;
+
+    private:
+        template<typename TLookup>
+        inline const Node* find_node(const TLookup& key) const {
+            if (m_count == 0) {
+                return nullptr;
+            }
+            std::uint64_t hash_code = THash::hash_code(key);
+            const Node* node = m_data + frozen_hash_slot(hash_code, m_displacements[frozen_hash_bucket(hash_code, m_bucket_count)], m_count);
+
+            return (node->get_key() == key) ? node : nullptr;
+        }
+
+        inline void allocate() {
+            m_data = m_allocator.allocate(m_count + 1);
+            m_displacements = m_displacement_allocator.allocate(m_bucket_count);
+            m_valid = true;
+        }
+
+        // Frees the table of a build that failed and leaves the map empty.
+        inline void fail() {
+            m_allocator.deallocate(m_data, m_count + 1);
+            m_displacement_allocator.deallocate(m_displacements, m_bucket_count);
+            m_data = nullptr;
+            m_displacements = nullptr;
+            m_count = 0;
+            m_valid = false;
+        }
+
+    private:
+        Node* m_data;
+        std::uint32_t* m_displacements;
+        std::uint32_t m_count;
+        std::uint32_t m_bucket_count;
+        bool m_valid;
+        typename std::allocator_traits<TAllocator>::template rebind_alloc<Node> m_allocator;
+        typename std::allocator_traits<TAllocator>::template rebind_alloc<std::uint32_t> m_displacement_allocator;
+    };
+
+    // A frozen map over a fixed set of TCount entries that can be built at
+    // compile time, provided TKey and TValue are literal, default
+    // constructible types and THash is constexpr.
+    template<typename TKey, typename TValue, std::uint32_t TCount, typename THash = HashCode<TKey>>
+    class StaticFrozenHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Node  = HashNode<TKey, TValue, void>;
+
+        static_assert(TCount != 0, "StaticFrozenHashMap requires at least one entry");
+
+    public:
+        constexpr explicit StaticFrozenHashMap(const std::pair<TKey, TValue> (&entries)[TCount]) : m_data(), m_displacements(), m_valid(false) {
+            std::uint64_t hash_codes[TCount] = {};
+            std::uint32_t slots[TCount] = {};
+            for (std::uint32_t i = 0; i < TCount; i++) {
+                hash_codes[i] = THash::hash_code(entries[i].first);
+            }
+            m_valid = frozen_hash_build(hash_codes, TCount, m_displacements.data(), BUCKET_COUNT, slots);
+            if (m_valid) {
+                for (std::uint32_t i = 0; i < TCount; i++) {
+                    m_data[slots[i]] = Node(entries[i].first, entries[i].second);
+                }
+            }
+        }
+
+        constexpr const Node* find(const TKey& key) const {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        constexpr const Node* find(const TLookup& key) const {
+            return find_node(key);
+        }
+
+        constexpr bool contains(const TKey& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        constexpr bool contains(const TLookup& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        constexpr const Node& operator [] (const TKey& key) const {
+            const Node* node = find_node(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        constexpr const Node& operator [] (const TLookup& key) const {
+            const Node* node = find_node(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        static constexpr std::uint32_t get_count() {
+            return TCount;
+        }
+
+        // False if the entries' keys are not distinct, in which case every
+        // lookup misses. A map built at compile time can static_assert it.
+        constexpr bool is_valid() const {
+            return m_valid;
+        }
+
+        constexpr const Node* begin() const {
+            return m_data.data();
+        }
+
+        constexpr const Node* end() const {
+            return m_data.data() + TCount;
+        }
+
+    private:
+        static constexpr std::uint32_t BUCKET_COUNT = frozen_hash_bucket_count(TCount);
+
+        template<typename TLookup>
+        constexpr const Node* find_node(const TLookup& key) const {
+            if (!m_valid) {
+                return nullptr;
+            }
+            std::uint64_t hash_code = THash::hash_code(key);
+            const Node* node = m_data.data() + frozen_hash_slot(hash_code, m_displacements[frozen_hash_bucket(hash_code, BUCKET_COUNT)], TCount);
+
+            return (node->get_key() == key) ? node : nullptr;
+        }
+
+    private:
+        std::array<Node, TCount> m_data;
+        std::array<std::uint32_t, BUCKET_COUNT> m_displacements;
+        bool m_valid;
+    };
+}
\ No newline at end of file
@@ -4,40 +4,53 @@
 #include <cstdint>
 #include <utility>
 #include <cstring>
+#include <type_traits>
+#include <string>
+#include <string_view>
+#include <span>
+#include <tuple>
+#include <cstddef>
+#include <bit>
+#include <limits>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 #include <assert.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "algorithm.h"
+#include "bitset.h"
 
 namespace ccnt {
-    template<typename TKey, typename TValue> 
+    class SplitLayout;
+
+    template<typename TKey, typename TValue, typename THashCode = std::uint32_t> 
     class HashNode {
     public:
-        template<typename... TArgs>
-        HashNode(std::uint32_t hash_code, const TKey& key, TArgs&&... args) : m_hash_code(hash_code), m_key(std::move(key)), m_value(std::forward<TArgs>(args)...) {
-        }
-
-        HashNode(std::uint32_t hash_code, const TKey& key, const TValue& value) : m_hash_code(hash_code), m_key(std::move(key)), m_value(std::move(value)) {
+        template<typename TKeyArg, typename... TArgs>
+        HashNode(THashCode hash_code, TKeyArg&& key, TArgs&&... args) : m_hash_code(hash_code), m_key(std::forward<TKeyArg>(key)), m_value(std::forward<TArgs>(args)...) {
         }
 
-        HashNode(HashNode<TKey, TValue>&& hash_node) : m_hash_code(hash_node.m_hash_code), m_key(std::move(hash_node.m_key)), m_value(std::move(hash_node.m_value)) {
+        HashNode(THashCode hash_code, const TKey& key, const TValue& value) : m_hash_code(hash_code), m_key(std::move(key)), m_value(std::move(value)) {
         }
 
-        ~HashNode() {
-            m_hash_code = 0;
+        HashNode(HashNode<TKey, TValue, THashCode>&& hash_node) : m_hash_code(hash_node.m_hash_code), m_key(std::move(hash_node.m_key)), m_value(std::move(hash_node.m_value)) {
         }
 
-        inline HashNode<TKey, TValue>& operator = (HashNode<TKey, TValue>&& hash_node) {
+        inline HashNode<TKey, TValue, THashCode>& operator = (HashNode<TKey, TValue, THashCode>&& hash_node) {
             m_value = std::move(hash_node.m_value);
 
             return *this;
         }
 
-        inline HashNode<TKey, TValue>& operator = (TValue&& value) {
+        inline HashNode<TKey, TValue, THashCode>& operator = (TValue&& value) {
             m_value = std::move(value);
 
             return *this;
         }
 
-        inline void set_hash_code(std::uint32_t hash_code) {
+        inline void set_hash_code(THashCode hash_code) {
             m_hash_code = hash_code;
         }
 
@@ -49,7 +62,7 @@ namespace ccnt {
             return m_value; 
         }
 
-        inline std::uint32_t get_hash_code() const { 
+        inline THashCode get_hash_code() const { 
             return m_hash_code; 
         }
 
@@ -66,565 +79,2413 @@ namespace ccnt {
         }
 
     private:
-        TValue m_value;
+        [[no_unique_address]] TValue m_value;
         TKey m_key;
-        std::uint32_t m_hash_code;
+        THashCode m_hash_code;
+
+        friend class SplitLayout;
     };
 
-    template<typename TKey>
-    class HashCode {
+    // A node that stores no hash code, for containers that never compare or
+    // rehash by it.
+    template<typename TKey, typename TValue>
+    class HashNode<TKey, TValue, void> {
     public:
-        static std::uint32_t hash_code (const TKey& key) {
-            return key;
+        constexpr HashNode() = default;
+
+        template<typename TKeyArg, typename... TArgs>
+        constexpr HashNode(TKeyArg&& key, TArgs&&... args) : m_value(std::forward<TArgs>(args)...), m_key(std::forward<TKeyArg>(key)) {
         }
-    };
 
-    class DivisionHashIndex {
-    public:
-        static std::uint32_t hash_index (std::uint32_t hash_code, std::uint32_t capacity) {
-            return hash_code % capacity;
+        constexpr operator const TValue&() const {
+            return m_value;
         }
-    };
 
-    template<typename TKey, typename TValue, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>>
-    class HashMap {
-    public:
-        using Value = TValue;
-        using Key   = TKey;
+        constexpr const TKey& get_key() const {
+            return m_key;
+        }
 
-        class Iterator {
-        public:
-            using Type = SparseIterator;
-            using ValueType = HashNode<TKey, TValue>;
-            using Pointer   = HashNode<TKey, TValue>*;
-            using Reference = HashNode<TKey, TValue>&;
+        constexpr TValue& get_value() {
+            return m_value;
+        }
 
-        public:
-            Iterator(Pointer data, const Pointer& head) : m_data(data), m_head(head) {
-            };
-            ~Iterator() = default;
+        constexpr const TValue& get_value() const {
+            return m_value;
+        }
 
-            Reference operator * () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
-                return *m_data;
-            }
+    private:
+        [[no_unique_address]] TValue m_value;
+        TKey m_key;
+    };
 
-            Pointer operator -> () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
-                return m_data; 
-            }
+    // Owns a node taken out of a HashMap by extract. The node keeps its hash
+    // code, so inserting it into a map with the same THash rehashes nothing
+    // and moves the key and value rather than copying them.
+    template<typename TKey, typename TValue, typename THashCode = std::uint32_t>
+    class HashNodeHandle {
+    public:
+        using Node = HashNode<TKey, TValue, THashCode>;
 
-            void operator ++ () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
-                do {
-                    m_data++;
-                    if (m_data == m_head) {
-                        break;
-                    }
-                } while (!(m_data->get_hash_code()));
-            }
+    public:
+        HashNodeHandle() : m_empty(true) {
+        }
 
-            bool operator == (const Iterator& it) {
-                if (m_data == it.m_data) {
-                    return true;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                    if (m_data == it.m_data) {
-                        return true;
-                    }
-                }
-                return false;
+        HashNodeHandle(HashNodeHandle&& handle) : m_empty(handle.m_empty) {
+            if (!m_empty) {
+                std::construct_at(&m_node, std::move(handle.m_node));
+                handle.reset();
             }
+        }
 
-            bool operator != (const Iterator& it) {
-                if (m_data == it.m_data) {
-                    return false;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                    if (m_data == it.m_data) {
-                        return false;
-                    }
-                }
-                return true;
-            }
+        ~HashNodeHandle() {
+            reset();
+        }
 
-        public:
-            Pointer m_data;
-            const Pointer& m_head;
-        };
+        inline HashNodeHandle& operator = (HashNodeHandle&& handle) {
+            reset();
+            std::construct_at(this, std::move(handle));
 
-        class ReverseIterator {
-        public:
-            using Type = SparseIterator;
-            using ValueType = HashNode<TKey, TValue>;
-            using Pointer   = HashNode<TKey, TValue>*;
-            using Reference = HashNode<TKey, TValue>&;
+            return *this;
+        }
 
-        public:
-            ReverseIterator(Pointer data, const Pointer& head) : m_data(data), m_head(head) {
-            };
-            ~ReverseIterator() = default;
+        inline bool is_empty() const {
+            return m_empty;
+        }
 
-            Reference operator * () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                return *m_data;
-            }
+        inline THashCode get_hash_code() const {
+            assert(!m_empty);
+            return m_node.get_hash_code();
+        }
 
-            Pointer operator -> () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                return m_data; 
-            }
+        inline const TKey& get_key() const {
+            assert(!m_empty);
+            return m_node.get_key();
+        }
 
-            void operator ++ () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                do {
-                    m_data--;
-                    if (m_data == m_head) {
-                        break;
-                    }
-                } while (!(m_data->get_hash_code()));
-            }
+        inline TValue& get_value() {
+            assert(!m_empty);
+            return m_node.get_value();
+        }
 
-            bool operator == (const ReverseIterator& it) {
-                if (m_data == it.m_data) {
-                    return true;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                    if (m_data == it.m_data) {
-                        return true;
-                    }
-                }
-                return false;
-            }
+        inline const TValue& get_value() const {
+            assert(!m_empty);
+            return m_node.get_value();
+        }
 
-            bool operator != (const ReverseIterator& it) {
-                if (m_data == it.m_data) {
-                    return false;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                    if (m_data == it.m_data) {
-                        return false;
-                    }
-                }
-                return true;
+        HashNodeHandle(const HashNodeHandle&) = delete;
+        HashNodeHandle& operator = (const HashNodeHandle&) = delete;
+
+    private:
+        inline void reset() {
+            if (!m_empty) {
+                std::destroy_at(&m_node);
+                m_empty = true;
             }
+        }
 
-        private:
-            Pointer m_data;
-            const Pointer& m_head;
+    private:
+        union {
+            Node m_node;
         };
+        bool m_empty;
 
-        class ConstIterator {
-        public:
-            using Type = SparseIterator;
-            using ValueType = const HashNode<TKey, TValue>;
-            using Pointer   = const HashNode<TKey, TValue>*;
-            using Reference = const HashNode<TKey, TValue>&;
+        template<typename, typename, typename, typename, typename, typename, typename, typename>
+        friend class HashMap;
+    };
 
-        public:
-            ConstIterator(HashNode<TKey, TValue>* data, const Pointer& head) : m_data(data), m_head(head) {
-            };
-            ~ConstIterator() = default;
+    // Hashing is built around the wyhash mixing primitives: a 64x64->128 bit
+    // multiply folded back to 64 bits.
+    constexpr std::uint64_t HASH_SECRET[4] = {
+        0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+    };
 
-            Reference operator * () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
-                return *m_data;
+    constexpr void hash_multiply(std::uint64_t& a, std::uint64_t& b) {
+#if defined(__SIZEOF_INT128__)
+        __uint128_t r = static_cast<__uint128_t>(a) * b;
+        a = static_cast<std::uint64_t>(r);
+        b = static_cast<std::uint64_t>(r >> 64);
+#else
+        std::uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<std::uint32_t>(a), lb = static_cast<std::uint32_t>(b);
+        std::uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32);
+        std::uint64_t c = t < rl;
+        std::uint64_t lo = t + (rm1 << 32);
+        c += lo < t;
+        a = lo;
+        b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+    }
+
+    constexpr std::uint64_t hash_mix(std::uint64_t a, std::uint64_t b) {
+        hash_multiply(a, b);
+        return a ^ b;
+    }
+
+    constexpr std::uint64_t hash_combine(std::uint64_t seed, std::uint64_t hash_code) {
+        return hash_mix(seed ^ HASH_SECRET[0], hash_code ^ HASH_SECRET[1]);
+    }
+
+    template<typename TByte>
+    constexpr std::uint64_t hash_read(const TByte* data, std::uint32_t nbytes) {
+        std::uint64_t value = 0;
+        for (std::uint32_t i = 0; i < nbytes; i++) {
+            value |= static_cast<std::uint64_t>(static_cast<std::uint8_t>(data[i])) << (i * 8);
+        }
+        return value;
+    }
+
+    template<typename TByte>
+    constexpr std::uint64_t hash_bytes(const TByte* data, std::size_t size, std::uint64_t seed = 0) {
+        static_assert(sizeof(TByte) == 1, "hash_bytes hashes byte sequences");
+
+        seed ^= hash_mix(seed ^ HASH_SECRET[0], HASH_SECRET[1]);
+        std::uint64_t a = 0;
+        std::uint64_t b = 0;
+
+        if (size <= 16) {
+            if (size >= 4) {
+                std::size_t offset = (size >> 3) << 2;
+                a = (hash_read(data, 4) << 32) | hash_read(data + offset, 4);
+                b = (hash_read(data + size - 4, 4) << 32) | hash_read(data + size - 4 - offset, 4);
             }
-
-            Pointer operator -> () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
-                return m_data; 
+            else if (size > 0) {
+                a = (hash_read(data, 1) << 16) | (hash_read(data + (size >> 1), 1) << 8) | hash_read(data + size - 1, 1);
             }
-
-            void operator ++ () {
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                }
+        }
+        else {
+            std::size_t remaining = size;
+            if (remaining > 48) {
+                std::uint64_t seed1 = seed;
+                std::uint64_t seed2 = seed;
                 do {
-                    m_data++;
-                    if (m_data == m_head) {
-                        break;
-                    }
-                } while (!(m_data->get_hash_code()));
-            }
-
-            bool operator == (const ConstIterator& it) {
-                if (m_data == it.m_data) {
-                    return true;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                    if (m_data == it.m_data) {
-                        return true;
-                    }
-                }
-                return false;
+                    seed = hash_mix(hash_read(data, 8) ^ HASH_SECRET[1], hash_read(data + 8, 8) ^ seed);
+                    seed1 = hash_mix(hash_read(data + 16, 8) ^ HASH_SECRET[2], hash_read(data + 24, 8) ^ seed1);
+                    seed2 = hash_mix(hash_read(data + 32, 8) ^ HASH_SECRET[3], hash_read(data + 40, 8) ^ seed2);
+                    data += 48;
+                    remaining -= 48;
+                } while (remaining > 48);
+                seed ^= seed1 ^ seed2;
             }
-
-            bool operator != (const ConstIterator& it) {
-                if (m_data == it.m_data) {
-                    return false;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data++;
-                    if (m_data == it.m_data) {
-                        return false;
-                    }
-                }
-                return true;
+            while (remaining > 16) {
+                seed = hash_mix(hash_read(data, 8) ^ HASH_SECRET[1], hash_read(data + 8, 8) ^ seed);
+                data += 16;
+                remaining -= 16;
             }
+            a = hash_read(data + remaining - 16, 8);
+            b = hash_read(data + remaining - 8, 8);
+        }
 
-        protected:
-            HashNode<TKey, TValue>* m_data;
-            Pointer& m_head;
-        };
-
-
-        class ConstReverseIterator {
-        public:
-            using Type = SparseIterator;
-            using ValueType = const HashNode<TKey, TValue>;
-            using Pointer   = const HashNode<TKey, TValue>*;
-            using Reference = const HashNode<TKey, TValue>&;
+        a ^= HASH_SECRET[1];
+        b ^= seed;
+        hash_multiply(a, b);
+        return hash_mix(a ^ HASH_SECRET[0] ^ size, b ^ HASH_SECRET[1]);
+    }
 
-        public:
-            ConstReverseIterator(HashNode<TKey, TValue>* data, const Pointer& head) : m_data(data), m_head(head) {
-            };
-            ~ConstReverseIterator() = default;
+    // Specialize HashCode for user types; hash_combine folds member hashes
+    // together. Hash codes are 64 bits wide and truncated to the width the
+    // container stores.
+    template<typename TKey, typename = std::nullptr_t>
+    class HashCode;
 
-            Reference operator * () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                return *m_data;
-            }
+    template<typename TKey>
+    class HashCode<TKey, typename std::enable_if<std::is_integral<TKey>::value || std::is_enum<TKey>::value, std::nullptr_t>::type> {
+    public:
+        static constexpr std::uint64_t hash_code (TKey key) {
+            return hash_mix(static_cast<std::uint64_t>(key) ^ HASH_SECRET[0], HASH_SECRET[1]);
+        }
+    };
 
-            Pointer operator -> () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                return m_data; 
-            }
+    template<typename TKey>
+    class HashCode<TKey*> {
+    public:
+        static std::uint64_t hash_code (const TKey* key) {
+            return hash_mix(reinterpret_cast<std::uintptr_t>(key) ^ HASH_SECRET[0], HASH_SECRET[1]);
+        }
+    };
 
-            void operator ++ () {
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                }
-                do {
-                    m_data--;
-                    if (m_data == m_head) {
-                        break;
-                    }
-                } while (!(m_data->get_hash_code()));
-            }
+    // Transparent hashers declare is_transparent and hash every type they
+    // accept the same way, so a HashMap can be searched without building a key.
+    template<>
+    class HashCode<std::string_view> {
+    public:
+        using is_transparent = void;
 
-            bool operator == (const ConstReverseIterator& it) {
-                if (m_data == it.m_data) {
-                    return true;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                    if (m_data == it.m_data) {
-                        return true;
-                    }
-                }
-                return false;
-            }
+        static constexpr std::uint64_t hash_code (std::string_view key) {
+            return hash_bytes(key.data(), key.size());
+        }
+    };
 
-            bool operator != (const ConstReverseIterator& it) {
-                if (m_data == it.m_data) {
-                    return false;
-                }
-                while (!(m_data->get_hash_code())) {
-                    m_data--;
-                    if (m_data == it.m_data) {
-                        return false;
-                    }
-                }
-                return true;
-            }
+    template<>
+    class HashCode<std::string> {
+    public:
+        using is_transparent = void;
 
-        private:
-            HashNode<TKey, TValue>* m_data;
-            Pointer& m_head;
-        };
+        static constexpr std::uint64_t hash_code (std::string_view key) {
+            return hash_bytes(key.data(), key.size());
+        }
+    };
 
+    template<>
+    class HashCode<std::span<const std::byte>> {
     public:
-        HashMap() : m_count(0), m_capacity(16) {
-            m_data = m_allocator.allocate(m_capacity);
-            m_head = m_data + m_capacity;
-            clear_hash_codes();
+        static std::uint64_t hash_code (std::span<const std::byte> key) {
+            return hash_bytes(key.data(), key.size());
         }
+    };
 
-        HashMap(HashMap&& hash_map) : m_data(hash_map.m_data), m_head(hash_map.m_head), m_count(hash_map.m_count), m_allocator(hash_map.m_allocator){
-            hash_map.m_data = nullptr;
-            hash_map.m_head = nullptr;
-            hash_map.m_count = 0;
-            hash_map.m_capacity = 0;
+    template<typename TFirst, typename TSecond>
+    class HashCode<std::pair<TFirst, TSecond>> {
+    public:
+        static constexpr std::uint64_t hash_code (const std::pair<TFirst, TSecond>& key) {
+            return hash_combine(HashCode<TFirst>::hash_code(key.first), HashCode<TSecond>::hash_code(key.second));
         }
+    };
 
-        ~HashMap() {
-            for (std::uint32_t i = 0; i < m_capacity; i++) {
-                std::uint32_t destroyed = 0;
-                if (m_data[i].get_hash_code()) {
-                    std::destroy_at(&m_data[i].get_value());
-                    destroyed++;
-                }
-                if (destroyed == m_count) {
-                    m_allocator.deallocate(m_data, m_capacity);
-                    return;
-                }
-            }
-            m_allocator.deallocate(m_data, m_capacity);
+    template<typename... TKeys>
+    class HashCode<std::tuple<TKeys...>> {
+    public:
+        static constexpr std::uint64_t hash_code (const std::tuple<TKeys...>& key) {
+            return std::apply([](const TKeys&... keys) {
+                std::uint64_t hash_code = HASH_SECRET[2];
+                ((hash_code = hash_combine(hash_code, HashCode<TKeys>::hash_code(keys))), ...);
+                return hash_code;
+            }, key);
         }
+    };
 
-        template<typename... TArgs>
-        inline HashNode<TKey, TValue>& emplace(const TKey& key, TArgs&&... args) {
-            std::uint32_t hash_code = HashCode<TKey>::hash_code(key);
-            assert(hash_code != 0);
-            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
-
-            while (m_data[hash_index].get_hash_code()) {
-                if (++hash_index == m_capacity) {
-                    grow(m_capacity + (m_capacity * 2));
-                    return emplace(key, std::forward<TArgs>(args)...);
-                }
-            }
+    template<typename THash, typename = std::nullptr_t>
+    class IsTransparentHash : public std::false_type {
+    };
 
-            std::construct_at(m_data + hash_index, hash_code, key, std::forward<TArgs>(args)...);
-            m_count++;
+    template<typename THash>
+    class IsTransparentHash<THash, typename std::conditional<true, std::nullptr_t, typename THash::is_transparent>::type> : public std::true_type {
+    };
 
-            return m_data[hash_index];
-        }
+    template<typename TIterator, typename = std::nullptr_t>
+    class IsRandomAccessIterator : public std::is_pointer<TIterator> {
+    };
 
-        inline HashNode<TKey, TValue>& insert(const TKey& key, const TValue& value ) {
-            std::uint32_t hash_code = HashCode<TKey>::hash_code(key);
-            assert(hash_code != 0);
-            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+    template<typename TIterator>
+    class IsRandomAccessIterator<TIterator, typename std::enable_if<std::is_same<RandomAccessIterator, typename TIterator::Type>::value, std::nullptr_t>::type> : public std::true_type {
+    };
 
-            while (m_data[hash_index].get_hash_code()) {
-                if (++hash_index == m_capacity) {
-                    grow(m_capacity + (m_capacity * 2));
-                    return insert(key, value);
-                }
-            }
+    inline void hash_prefetch(const void* address) {
+#if defined(__SSE2__)
+        _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#endif
+    }
+
+    // One control byte per slot: EMPTY, DELETED, or the top 7 bits of the hash
+    // code when the slot is full. A group matches a tag against WIDTH bytes at once.
+    // Index policies pick the home slot from the low bits, or from a product
+    // of the whole code, so keys sharing a home slot rarely share a tag.
+    // The first WIDTH - 1 bytes are mirrored past the end of the table, so a
+    // group loaded near the end reads the slots it wraps around to.
+    class HashGroup {
+    public:
+        static constexpr std::uint32_t WIDTH = 16;
+        static constexpr std::int8_t EMPTY = -128;
+        static constexpr std::int8_t DELETED = -2;
 
-            std::construct_at(m_data + hash_index, hash_code, key, std::move(value));
-            m_count++;
+    public:
+#if defined(__SSE2__)
+        explicit HashGroup(const std::int8_t* control) : m_control(_mm_loadu_si128(reinterpret_cast<const __m128i*>(control))) {
+        }
 
-            return m_data[hash_index];
+        inline std::uint32_t match(std::int8_t tag) const {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), m_control)));
         }
 
-        inline HashMap& operator = (HashMap&& hash_map) {
-            hash_map.m_data = hash_map.m_data;
-            hash_map.m_head = hash_map.m_head;
-            hash_map.m_count = hash_map.m_count;
-            hash_map.m_capacity = hash_map.m_capacity;
+        inline std::uint32_t match_empty_or_deleted() const {
+            return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), m_control)));
+        }
+#else
+        explicit HashGroup(const std::int8_t* control) {
+            std::memcpy(m_control, control, WIDTH);
+        }
 
-            hash_map.m_data = nullptr;
-            hash_map.m_head = nullptr;
-            hash_map.m_count = 0;
-            hash_map.m_capacity = 0;
+        inline std::uint32_t match(std::int8_t tag) const {
+            std::uint32_t mask = 0;
+            for (std::uint32_t i = 0; i < WIDTH; i++) {
+                mask |= static_cast<std::uint32_t>(m_control[i] == tag) << i;
+            }
+            return mask;
         }
 
-        inline HashNode<TKey, TValue>& operator [] (const TKey& key) {
-            std::uint32_t hash_code = HashCode<TKey>::hash_code(key);
-            assert(hash_code != 0);
-            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
-            
-            do {
-                assert(hash_index != m_capacity);
-                while (m_data[hash_index].get_hash_code() != hash_code) {
+        inline std::uint32_t match_empty_or_deleted() const {
+            std::uint32_t mask = 0;
+            for (std::uint32_t i = 0; i < WIDTH; i++) {
+                mask |= static_cast<std::uint32_t>(m_control[i] < -1) << i;
+            }
+            return mask;
+        }
+#endif
 
-                    hash_index++;
-                    assert(hash_index != m_capacity);
-                }
-            } while (m_data[hash_index++].get_key() != key);
+        inline std::uint32_t match_empty() const {
+            return match(EMPTY);
+        }
 
-            return m_data[hash_index - 1];
+        template<typename THashCode>
+        static inline std::int8_t tag(THashCode hash_code) {
+            static_assert(std::is_unsigned<THashCode>::value, "hash codes are unsigned");
+            return static_cast<std::int8_t>(hash_code >> (std::numeric_limits<THashCode>::digits - 7));
         }
 
-        inline const HashNode<TKey, TValue>& operator [] (const TKey& key) const {
-            std::uint32_t hash_code = HashCode<TKey>::hash_code(key);
-            assert(hash_code != 0);
-            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
-            
-            do {
-                assert(hash_index != m_capacity);
-                while (m_data[hash_index].get_hash_code() != hash_code) {
+    private:
+#if defined(__SSE2__)
+        __m128i m_control;
+#else
+        std::int8_t m_control[WIDTH];
+#endif
+    };
 
-                    hash_index++;
-                    assert(hash_index != m_capacity);
-                }
-            } while (m_data[hash_index++].get_key() != key);
+    class DivisionHashIndex {
+    public:
+        static constexpr bool POWER_OF_TWO = false;
 
-            return m_data[hash_index - 1];
+        template<typename THashCode>
+        static std::uint32_t hash_index (THashCode hash_code, std::uint32_t capacity) {
+            return hash_code % capacity;
         }
+    };
 
-        inline void remove(const TKey& key) {
-            std::uint32_t hash_code = HashCode<TKey>::hash_code(key);
-            assert(hash_code != 0);
-            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+    // Keeps the low bits of the hash code. It equals DivisionHashIndex at
+    // power of two capacities without the division, and relies on the hash
+    // mixing every input bit into the low ones. Control tags come from the
+    // top bits, so they stay independent of the slot it picks.
+    class MaskHashIndex {
+    public:
+        static constexpr bool POWER_OF_TWO = true;
 
-            do {
-                assert(hash_index != m_capacity);
-                while (m_data[hash_index].get_hash_code() != hash_code) {
+        template<typename THashCode>
+        static std::uint32_t hash_index (THashCode hash_code, std::uint32_t capacity) {
+            return hash_code & (capacity - 1);
+        }
+    };
 
-                    hash_index++;
-                    assert(hash_index != m_capacity);
-                }
-            } while (m_data[hash_index++].get_key() != key);
+    // Multiplies by 2^64 / phi and keeps the top bits, which spreads keys that
+    // only differ in their high bits as well. A capacity of 1 would keep no
+    // bits, so capacities start at 2.
+    class FibonacciHashIndex {
+    public:
+        static constexpr bool POWER_OF_TWO = true;
 
-            std::destroy_at(m_data + hash_index - 1);
+        template<typename THashCode>
+        static std::uint32_t hash_index (THashCode hash_code, std::uint32_t capacity) {
+            assert(capacity > 1 && "FibonacciHashIndex requires a capacity of at least 2");
+            return (static_cast<std::uint64_t>(hash_code) * 11400714819323198485ull) >> (64 - std::countr_zero(capacity));
         }
+    };
 
-        inline void clear() {
-            for (std::uint32_t i = 0; i < m_capacity; i++) {
-                std::uint32_t destroyed = 0;
-                if (m_data[i].get_hash_code()) {
-                    std::destroy_at(&m_data[i].get_value());
-                    destroyed++;
-                }
-                if (destroyed == m_count) {
-                    clear_hash_codes();
-                    m_count = 0;
-                    return;
-                }
-            }
+    // Refers to a node whose hash code, key and value are stored apart. It
+    // stands in for both a reference and a pointer to a HashNode, so it can
+    // be null and dereferences to itself.
+    template<typename TKey, typename TValue, typename THashCode = std::uint32_t>
+    class HashNodeView {
+    public:
+        HashNodeView(std::nullptr_t = nullptr) : m_hash_code(nullptr), m_key(nullptr), m_value(nullptr) {
         }
 
-        Iterator begin() {
-            if (m_count == 0) {
-                return Iterator(m_head, m_head);
-            }
-            auto* data = m_data;
-            while (!data->get_hash_code()) {
-                data++;
-            }
-            return Iterator(data, m_head);
-        } 
+        HashNodeView(const THashCode* hash_code, const TKey* key, TValue* value) : m_hash_code(hash_code), m_key(key), m_value(value) {
+        }
 
-        Iterator end() {
-            return Iterator(m_data + m_capacity, m_head);
+        template<typename TValue1, typename std::enable_if<std::is_convertible<TValue1*, TValue*>::value, std::nullptr_t>::type = nullptr>
+        HashNodeView(const HashNodeView<TKey, TValue1, THashCode>& view) : m_hash_code(view.m_hash_code), m_key(view.m_key), m_value(view.m_value) {
         }
 
-        ConstIterator begin() const {
-            if (m_count == 0) {
-                return Iterator(m_head, m_head);
-            }
-            auto* data = m_data;
-            while (!data->get_hash_code()) {
-                data++;
-            }
-            return ConstIterator(data, m_head);
-        } 
+        inline operator TValue&() const {
+            return *m_value;
+        }
 
-        ConstIterator end() const {
-            return ConstIterator(m_data + m_capacity, m_head);
+        inline THashCode get_hash_code() const {
+            return *m_hash_code;
         }
 
-        ConstIterator cbegin() const {
-            auto* data = m_data;
-            while (!data->get_hash_code()) {
-                data++;
-            }
-            return ConstIterator(data, m_head);
-        } 
+        inline const TKey& get_key() const {
+            return *m_key;
+        }
 
-        ConstIterator cend() const {
-            return ConstIterator(m_data + m_capacity, m_head);
+        inline TValue& get_value() const {
+            return *m_value;
         }
 
-        ReverseIterator rbegin() {
-            if (m_count == 0) {
-                return Iterator(m_head, m_data);
-            }
-            auto* data = m_head;
-            while (!data->get_hash_code()) {
-                data--;
-            }
-            return ReverseIterator(data, m_data);
-        } 
+        inline const HashNodeView& operator * () const {
+            return *this;
+        }
 
-        ReverseIterator rend() {
-            return ReverseIterator(m_data, m_data);
+        inline const HashNodeView* operator -> () const {
+            return this;
         }
 
-        ConstReverseIterator crbegin() const {
-            if (m_count == 0) {
-                return Iterator(m_head, m_data);
+        inline bool operator == (std::nullptr_t) const {
+            return m_key == nullptr;
+        }
+
+    private:
+        const THashCode* m_hash_code;
+        const TKey* m_key;
+        TValue* m_value;
+
+        template<typename, typename, typename>
+        friend class HashNodeView;
+    };
+
+    // Layouts decide how a HashMap stores its slots. The Data handle they
+    // provide is a shallow, copyable reference to one table's storage.
+    //
+    // InterleavedLayout keeps each slot's hash code, key and value together in
+    // a HashNode.
+    class InterleavedLayout {
+    public:
+        template<typename TKey, typename TValue, typename THashCode>
+        class Data {
+        public:
+            using Node           = HashNode<TKey, TValue, THashCode>;
+            using Reference      = Node&;
+            using ConstReference = const Node&;
+            using Pointer        = Node*;
+            using ConstPointer   = const Node*;
+
+            static constexpr std::size_t SLOT_SIZE = sizeof(Node);
+
+        public:
+            Data(std::nullptr_t = nullptr) : m_nodes(nullptr) {
+            }
+
+            template<typename TAllocator>
+            inline void allocate(TAllocator& allocator, std::uint32_t capacity) {
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<Node> node_allocator(allocator);
+                m_nodes = node_allocator.allocate(capacity);
+            }
+
+            template<typename TAllocator>
+            inline void deallocate(TAllocator& allocator, std::uint32_t capacity) {
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<Node> node_allocator(allocator);
+                node_allocator.deallocate(m_nodes, capacity);
+            }
+
+            template<typename... TArgs>
+            inline void construct(std::uint32_t index, THashCode hash_code, TArgs&&... args) const {
+                std::construct_at(m_nodes + index, hash_code, std::forward<TArgs>(args)...);
+            }
+
+            // Moves the slot at from_index of data into index and destroys the source.
+            inline void relocate(std::uint32_t index, Data data, std::uint32_t from_index) const {
+                std::construct_at(m_nodes + index, std::move(data.m_nodes[from_index]));
+                std::destroy_at(data.m_nodes + from_index);
+            }
+
+            inline void copy(std::uint32_t index, Data data, std::uint32_t from_index) const {
+                const Node& node = data.m_nodes[from_index];
+                std::construct_at(m_nodes + index, node.get_hash_code(), node.get_key(), node.get_value());
+            }
+
+            inline void destroy(std::uint32_t index) const {
+                std::destroy_at(m_nodes + index);
+            }
+
+            // Moves the slot at index into node and destroys the slot.
+            inline void extract(std::uint32_t index, HashNode<TKey, TValue, THashCode>* node) const {
+                std::construct_at(node, std::move(m_nodes[index]));
+                std::destroy_at(m_nodes + index);
+            }
+
+            inline void insert(std::uint32_t index, HashNode<TKey, TValue, THashCode>&& node) const {
+                std::construct_at(m_nodes + index, std::move(node));
+            }
+
+            inline void prefetch(std::uint32_t index) const {
+                hash_prefetch(m_nodes + index);
+            }
+
+            inline THashCode get_hash_code(std::uint32_t index) const {
+                return m_nodes[index].get_hash_code();
+            }
+
+            inline const TKey& get_key(std::uint32_t index) const {
+                return m_nodes[index].get_key();
+            }
+
+            inline Reference operator [] (std::uint32_t index) const {
+                return m_nodes[index];
+            }
+
+            inline Pointer get_pointer(std::uint32_t index) const {
+                return m_nodes + index;
+            }
+
+            inline bool operator == (const Data& data) const {
+                return m_nodes == data.m_nodes;
+            }
+
+            inline bool operator == (std::nullptr_t) const {
+                return m_nodes == nullptr;
+            }
+
+        private:
+            Node* m_nodes;
+        };
+    };
+
+    // SplitLayout keeps hash codes, keys and values in three arrays, so probing
+    // never pulls value bytes into the cache. Nodes are handed out as
+    // HashNodeView, by value.
+    class SplitLayout {
+    public:
+        template<typename TKey, typename TValue, typename THashCode>
+        class Data {
+        public:
+            using Node           = HashNodeView<TKey, TValue, THashCode>;
+            using Reference      = Node;
+            using ConstReference = HashNodeView<TKey, const TValue, THashCode>;
+            using Pointer        = Node;
+            using ConstPointer   = ConstReference;
+
+            static constexpr std::size_t SLOT_SIZE = sizeof(THashCode) + sizeof(TKey) + sizeof(TValue);
+
+        public:
+            Data(std::nullptr_t = nullptr) : m_hash_codes(nullptr), m_keys(nullptr), m_values(nullptr) {
+            }
+
+            template<typename TAllocator>
+            inline void allocate(TAllocator& allocator, std::uint32_t capacity) {
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<THashCode> hash_code_allocator(allocator);
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<TKey> key_allocator(allocator);
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<TValue> value_allocator(allocator);
+                m_hash_codes = hash_code_allocator.allocate(capacity);
+                m_keys = key_allocator.allocate(capacity);
+                m_values = value_allocator.allocate(capacity);
+            }
+
+            template<typename TAllocator>
+            inline void deallocate(TAllocator& allocator, std::uint32_t capacity) {
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<THashCode> hash_code_allocator(allocator);
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<TKey> key_allocator(allocator);
+                typename std::allocator_traits<TAllocator>::template rebind_alloc<TValue> value_allocator(allocator);
+                hash_code_allocator.deallocate(m_hash_codes, capacity);
+                key_allocator.deallocate(m_keys, capacity);
+                value_allocator.deallocate(m_values, capacity);
+            }
+
+            template<typename TKeyArg, typename... TArgs>
+            inline void construct(std::uint32_t index, THashCode hash_code, TKeyArg&& key, TArgs&&... args) const {
+                m_hash_codes[index] = hash_code;
+                std::construct_at(m_keys + index, std::forward<TKeyArg>(key));
+                std::construct_at(m_values + index, std::forward<TArgs>(args)...);
+            }
+
+            inline void relocate(std::uint32_t index, Data data, std::uint32_t from_index) const {
+                m_hash_codes[index] = data.m_hash_codes[from_index];
+                std::construct_at(m_keys + index, std::move(data.m_keys[from_index]));
+                std::construct_at(m_values + index, std::move(data.m_values[from_index]));
+                data.destroy(from_index);
+            }
+
+            inline void copy(std::uint32_t index, Data data, std::uint32_t from_index) const {
+                m_hash_codes[index] = data.m_hash_codes[from_index];
+                std::construct_at(m_keys + index, data.m_keys[from_index]);
+                std::construct_at(m_values + index, data.m_values[from_index]);
+            }
+
+            inline void destroy(std::uint32_t index) const {
+                std::destroy_at(m_keys + index);
+                std::destroy_at(m_values + index);
+            }
+
+            inline void extract(std::uint32_t index, HashNode<TKey, TValue, THashCode>* node) const {
+                std::construct_at(node, m_hash_codes[index], std::move(m_keys[index]), std::move(m_values[index]));
+                destroy(index);
+            }
+
+            inline void insert(std::uint32_t index, HashNode<TKey, TValue, THashCode>&& node) const {
+                m_hash_codes[index] = node.m_hash_code;
+                std::construct_at(m_keys + index, std::move(node.m_key));
+                std::construct_at(m_values + index, std::move(node.m_value));
+            }
+
+            inline void prefetch(std::uint32_t index) const {
+                hash_prefetch(m_hash_codes + index);
+                hash_prefetch(m_keys + index);
+            }
+
+            inline THashCode get_hash_code(std::uint32_t index) const {
+                return m_hash_codes[index];
+            }
+
+            inline const TKey& get_key(std::uint32_t index) const {
+                return m_keys[index];
+            }
+
+            inline Reference operator [] (std::uint32_t index) const {
+                return get_pointer(index);
+            }
+
+            inline Pointer get_pointer(std::uint32_t index) const {
+                return Node(m_hash_codes + index, m_keys + index, m_values + index);
+            }
+
+            inline bool operator == (const Data& data) const {
+                return m_keys == data.m_keys;
+            }
+
+            inline bool operator == (std::nullptr_t) const {
+                return m_keys == nullptr;
+            }
+
+        private:
+            THashCode* m_hash_codes;
+            TKey* m_keys;
+            TValue* m_values;
+        };
+    };
+
+    // A snapshot of what a HashMap built with TrackHashStats has recorded.
+    // A probe's length is the number of groups it visited; the last bucket
+    // of the histogram also counts every longer probe. The cluster length is
+    // the longest run of slots that are not EMPTY, which bounds how far an
+    // unsuccessful lookup can probe. Tag matches count the slots whose control
+    // byte matched during a probe, each of which costs a key comparison.
+    struct HashStats {
+        static constexpr std::uint32_t PROBE_BUCKETS = 8;
+
+        std::uint64_t probe_lengths[PROBE_BUCKETS];
+        std::uint32_t max_probe_length;
+        std::uint64_t tag_matches;
+        std::uint64_t grows;
+        std::uint64_t rehashes;
+        std::uint64_t rehash_nanoseconds;
+        std::uint64_t allocated_bytes;
+        std::uint64_t peak_allocated_bytes;
+        std::uint32_t count;
+        std::uint32_t capacity;
+        std::uint32_t deleted;
+        std::uint32_t max_cluster_length;
+        float load_factor;
+    };
+
+    // The default statistics policy. Every hook is empty, so a HashMap built
+    // with it records nothing and stores nothing.
+    class NoHashStats {
+    public:
+        static constexpr bool ENABLED = false;
+
+    public:
+        inline void record_probe(std::uint32_t) {
+        }
+
+        inline void record_tag_match() {
+        }
+
+        inline void begin_rehash() {
+        }
+
+        inline void end_rehash(bool) {
+        }
+
+        inline void record_allocation(std::uint64_t) {
+        }
+
+        inline void record_deallocation(std::uint64_t) {
+        }
+    };
+
+    // Records probe lengths, rehashes and table allocations. Lookups update
+    // the counters as well, so a tracked map must not be read from several
+    // threads at once.
+    class TrackHashStats {
+    public:
+        static constexpr bool ENABLED = true;
+
+    public:
+        TrackHashStats() : m_stats() {
+        }
+
+        inline void record_probe(std::uint32_t length) {
+            m_stats.probe_lengths[std::min(length, HashStats::PROBE_BUCKETS) - 1]++;
+            m_stats.max_probe_length = std::max(m_stats.max_probe_length, length);
+        }
+
+        inline void record_tag_match() {
+            m_stats.tag_matches++;
+        }
+
+        inline void begin_rehash() {
+            m_start = std::chrono::steady_clock::now();
+        }
+
+        // A rehash at the same capacity only clears tombstones.
+        inline void end_rehash(bool grown) {
+            m_stats.rehash_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+            if (grown) {
+                m_stats.grows++;
+            }
+            else {
+                m_stats.rehashes++;
+            }
+        }
+
+        inline void record_allocation(std::uint64_t bytes) {
+            m_stats.allocated_bytes += bytes;
+            m_stats.peak_allocated_bytes = std::max(m_stats.peak_allocated_bytes, m_stats.allocated_bytes);
+        }
+
+        inline void record_deallocation(std::uint64_t bytes) {
+            m_stats.allocated_bytes -= bytes;
+        }
+
+        // Clears the counters but keeps the allocation still outstanding.
+        inline void reset() {
+            std::uint64_t allocated_bytes = m_stats.allocated_bytes;
+            m_stats = HashStats();
+            m_stats.allocated_bytes = allocated_bytes;
+            m_stats.peak_allocated_bytes = allocated_bytes;
+        }
+
+        inline const HashStats& get_stats() const {
+            return m_stats;
+        }
+
+    private:
+        HashStats m_stats;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    template<typename TKey, typename TValue, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t, typename TLayout = InterleavedLayout, typename TStats = NoHashStats>
+    class HashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Data  = typename TLayout::template Data<TKey, TValue, THashCode>;
+        using Node  = typename Data::Node;
+        using Reference      = typename Data::Reference;
+        using ConstReference = typename Data::ConstReference;
+        using Pointer        = typename Data::Pointer;
+        using ConstPointer   = typename Data::ConstPointer;
+        using NodeHandle     = HashNodeHandle<TKey, TValue, THashCode>;
+
+        static constexpr std::uint32_t DEFAULT_CAPACITY = 16;
+        static constexpr std::uint32_t BATCH_SIZE = 16;
+
+        static_assert(std::is_same<decltype(THashIndex::POWER_OF_TWO), const bool>::value, "THashIndex must declare whether it requires power of two capacities");
+        static_assert(!THashIndex::POWER_OF_TWO || std::has_single_bit(DEFAULT_CAPACITY), "THashIndex requires a power of two capacity");
+        static_assert(DEFAULT_CAPACITY >= HashGroup::WIDTH, "HashMap capacity must hold at least one group");
+
+        // While an incremental rehash is in progress the elements are split
+        // between the table being drained and the new one. Forward iterators
+        // walk the old table first and then move on to the new one, reverse
+        // iterators go the other way round.
+        class Iterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = Node;
+            using Pointer   = typename Data::Pointer;
+            using Reference = typename Data::Reference;
+
+        public:
+            Iterator(Data data, const Bitset<64>* occupancy, std::uint32_t index, std::uint32_t capacity, Data next_data = nullptr, const Bitset<64>* next_occupancy = nullptr, std::uint32_t next_capacity = 0) : m_data(data), m_occupancy(occupancy), m_index(index), m_capacity(capacity), m_next_data(next_data), m_next_occupancy(next_occupancy), m_next_capacity(next_capacity) {
+                skip_table();
+            };
+            ~Iterator() = default;
+
+            Reference operator * () {
+                return m_data[m_index];
+            }
+
+            Pointer operator -> () {
+                return m_data.get_pointer(m_index);
+            }
+
+            void operator ++ () {
+                m_index = next_occupied(m_occupancy, m_index + 1, m_capacity);
+                skip_table();
+            }
+
+            bool operator == (const Iterator& it) {
+                return m_index == it.m_index && m_data == it.m_data;
+            }
+
+            bool operator != (const Iterator& it) {
+                return m_index != it.m_index || m_data != it.m_data;
+            }
+
+        protected:
+            inline void skip_table() {
+                if (m_index == m_capacity && m_next_data != nullptr) {
+                    m_data = m_next_data;
+                    m_occupancy = m_next_occupancy;
+                    m_capacity = m_next_capacity;
+                    m_next_data = nullptr;
+                    m_index = next_occupied(m_occupancy, 0, m_capacity);
+                }
+            }
+
+        protected:
+            Data m_data;
+            const Bitset<64>* m_occupancy;
+            std::uint32_t m_index;
+            std::uint32_t m_capacity;
+            Data m_next_data;
+            const Bitset<64>* m_next_occupancy;
+            std::uint32_t m_next_capacity;
+        };
+
+        class ReverseIterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = Node;
+            using Pointer   = typename Data::Pointer;
+            using Reference = typename Data::Reference;
+
+        public:
+            ReverseIterator(Data data, const Bitset<64>* occupancy, std::uint32_t index, Data next_data = nullptr, const Bitset<64>* next_occupancy = nullptr, std::uint32_t next_capacity = 0) : m_data(data), m_occupancy(occupancy), m_index(index), m_next_data(next_data), m_next_occupancy(next_occupancy), m_next_capacity(next_capacity) {
+                skip_table();
+            };
+            ~ReverseIterator() = default;
+
+            Reference operator * () {
+                return m_data[m_index - 1];
+            }
+
+            Pointer operator -> () {
+                return m_data.get_pointer(m_index - 1);
+            }
+
+            void operator ++ () {
+                m_index = previous_occupied(m_occupancy, m_index - 1);
+                skip_table();
+            }
+
+            bool operator == (const ReverseIterator& it) {
+                return m_index == it.m_index && m_data == it.m_data;
+            }
+
+            bool operator != (const ReverseIterator& it) {
+                return m_index != it.m_index || m_data != it.m_data;
+            }
+
+        protected:
+            inline void skip_table() {
+                if (m_index == 0 && m_next_data != nullptr) {
+                    m_data = m_next_data;
+                    m_occupancy = m_next_occupancy;
+                    m_next_data = nullptr;
+                    m_index = previous_occupied(m_occupancy, m_next_capacity);
+                }
+            }
+
+        protected:
+            Data m_data;
+            const Bitset<64>* m_occupancy;
+            std::uint32_t m_index;
+            Data m_next_data;
+            const Bitset<64>* m_next_occupancy;
+            std::uint32_t m_next_capacity;
+        };
+
+        class ConstIterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = const Node;
+            using Pointer   = typename Data::ConstPointer;
+            using Reference = typename Data::ConstReference;
+
+        public:
+            ConstIterator(Data data, const Bitset<64>* occupancy, std::uint32_t index, std::uint32_t capacity, Data next_data = nullptr, const Bitset<64>* next_occupancy = nullptr, std::uint32_t next_capacity = 0) : m_data(data), m_occupancy(occupancy), m_index(index), m_capacity(capacity), m_next_data(next_data), m_next_occupancy(next_occupancy), m_next_capacity(next_capacity) {
+                skip_table();
+            };
+            ~ConstIterator() = default;
+
+            Reference operator * () const {
+                return m_data[m_index];
+            }
+
+            Pointer operator -> () const {
+                return m_data.get_pointer(m_index);
+            }
+
+            void operator ++ () {
+                m_index = next_occupied(m_occupancy, m_index + 1, m_capacity);
+                skip_table();
+            }
+
+            bool operator == (const ConstIterator& it) const {
+                return m_index == it.m_index && m_data == it.m_data;
+            }
+
+            bool operator != (const ConstIterator& it) const {
+                return m_index != it.m_index || m_data != it.m_data;
+            }
+
+        protected:
+            inline void skip_table() {
+                if (m_index == m_capacity && m_next_data != nullptr) {
+                    m_data = m_next_data;
+                    m_occupancy = m_next_occupancy;
+                    m_capacity = m_next_capacity;
+                    m_next_data = nullptr;
+                    m_index = next_occupied(m_occupancy, 0, m_capacity);
+                }
+            }
+
+        protected:
+            Data m_data;
+            const Bitset<64>* m_occupancy;
+            std::uint32_t m_index;
+            std::uint32_t m_capacity;
+            Data m_next_data;
+            const Bitset<64>* m_next_occupancy;
+            std::uint32_t m_next_capacity;
+        };
+
+        class ConstReverseIterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = const Node;
+            using Pointer   = typename Data::ConstPointer;
+            using Reference = typename Data::ConstReference;
+
+        public:
+            ConstReverseIterator(Data data, const Bitset<64>* occupancy, std::uint32_t index, Data next_data = nullptr, const Bitset<64>* next_occupancy = nullptr, std::uint32_t next_capacity = 0) : m_data(data), m_occupancy(occupancy), m_index(index), m_next_data(next_data), m_next_occupancy(next_occupancy), m_next_capacity(next_capacity) {
+                skip_table();
+            };
+            ~ConstReverseIterator() = default;
+
+            Reference operator * () const {
+                return m_data[m_index - 1];
+            }
+
+            Pointer operator -> () const {
+                return m_data.get_pointer(m_index - 1);
+            }
+
+            void operator ++ () {
+                m_index = previous_occupied(m_occupancy, m_index - 1);
+                skip_table();
+            }
+
+            bool operator == (const ConstReverseIterator& it) const {
+                return m_index == it.m_index && m_data == it.m_data;
+            }
+
+            bool operator != (const ConstReverseIterator& it) const {
+                return m_index != it.m_index || m_data != it.m_data;
+            }
+
+        protected:
+            inline void skip_table() {
+                if (m_index == 0 && m_next_data != nullptr) {
+                    m_data = m_next_data;
+                    m_occupancy = m_next_occupancy;
+                    m_next_data = nullptr;
+                    m_index = previous_occupied(m_occupancy, m_next_capacity);
+                }
+            }
+
+        protected:
+            Data m_data;
+            const Bitset<64>* m_occupancy;
+            std::uint32_t m_index;
+            Data m_next_data;
+            const Bitset<64>* m_next_occupancy;
+            std::uint32_t m_next_capacity;
+        };
+
+        // Walks every node whose key equals a given key, in probe order, for
+        // containers that keep duplicate keys. The table being drained by an
+        // incremental rehash is searched after the current one. The key is
+        // referred to, not copied, so it must outlive the iterator.
+        template<typename TLookup, typename TReference, typename TPointer>
+        class EqualIterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = Node;
+            using Pointer   = TPointer;
+            using Reference = TReference;
+
+        public:
+            EqualIterator() : m_key(nullptr), m_data(nullptr), m_index(NOT_FOUND) {
+            }
+
+            EqualIterator(const TLookup& key, THashCode hash_code, Data data, const std::int8_t* control, std::uint32_t capacity, Data next_data, const std::int8_t* next_control, std::uint32_t next_capacity) : m_key(&key), m_hash_code(hash_code), m_next_data(next_data), m_next_control(next_control), m_next_capacity(next_capacity) {
+                start(data, control, capacity);
+                advance();
+            }
+            ~EqualIterator() = default;
+
+            Reference operator * () const {
+                return m_data[m_index];
+            }
+
+            Pointer operator -> () const {
+                return m_data.get_pointer(m_index);
+            }
+
+            void operator ++ () {
+                advance();
+            }
+
+            bool operator == (const EqualIterator& it) const {
+                return m_index == it.m_index && m_data == it.m_data;
+            }
+
+            bool operator != (const EqualIterator& it) const {
+                return m_index != it.m_index || m_data != it.m_data;
+            }
+
+        protected:
+            inline void start(Data data, const std::int8_t* control, std::uint32_t capacity) {
+                m_data = data;
+                m_control = control;
+                m_capacity = capacity;
+                load_group(THashIndex::hash_index(m_hash_code, m_capacity));
+            }
+
+            inline void load_group(std::uint32_t group) {
+                HashGroup hash_group(m_control + group);
+                m_group = group;
+                m_match = hash_group.match(HashGroup::tag(m_hash_code));
+                m_last = hash_group.match_empty() != 0;
+            }
+
+            inline void advance() {
+                while (true) {
+                    while (m_match) {
+                        std::uint32_t index = wrap(m_group + std::countr_zero(m_match), m_capacity);
+                        m_match &= m_match - 1;
+                        if (m_data.get_hash_code(index) == m_hash_code && m_data.get_key(index) == *m_key) {
+                            m_index = index;
+                            return;
+                        }
+                    }
+                    if (!m_last) {
+                        load_group(wrap(m_group + HashGroup::WIDTH, m_capacity));
+                    }
+                    else if (m_next_data != nullptr) {
+                        start(m_next_data, m_next_control, m_next_capacity);
+                        m_next_data = nullptr;
+                    }
+                    else {
+                        m_data = nullptr;
+                        m_index = NOT_FOUND;
+                        return;
+                    }
+                }
+            }
+
+        protected:
+            const TLookup* m_key;
+            THashCode m_hash_code;
+            Data m_data;
+            const std::int8_t* m_control;
+            std::uint32_t m_capacity;
+            std::uint32_t m_group;
+            std::uint32_t m_match;
+            bool m_last;
+            std::uint32_t m_index;
+            Data m_next_data;
+            const std::int8_t* m_next_control;
+            std::uint32_t m_next_capacity;
+        };
+
+        template<typename TIterator>
+        class EqualRange {
+        public:
+            EqualRange(TIterator first) : m_first(first) {
+            }
+
+            TIterator begin() const {
+                return m_first;
+            }
+
+            TIterator end() const {
+                return TIterator();
+            }
+
+        private:
+            TIterator m_first;
+        };
+
+    public:
+        HashMap() : m_count(0), m_capacity(DEFAULT_CAPACITY), m_max_load_factor(0.875f), m_shrink_load_factor(0.0f), m_old_data(nullptr), m_old_control(nullptr), m_old_occupancy(nullptr), m_old_capacity(0), m_migrated(0), m_rehash_step(0) {
+            allocate();
+        }
+
+        explicit HashMap(std::uint32_t capacity) : m_count(0), m_capacity(round_capacity(capacity)), m_max_load_factor(0.875f), m_shrink_load_factor(0.0f), m_old_data(nullptr), m_old_control(nullptr), m_old_occupancy(nullptr), m_old_capacity(0), m_migrated(0), m_rehash_step(0) {
+            allocate();
+        }
+
+        HashMap(HashMap&& hash_map) : m_data(hash_map.m_data), m_control(hash_map.m_control), m_occupancy(hash_map.m_occupancy), m_count(hash_map.m_count), m_capacity(hash_map.m_capacity), m_deleted(hash_map.m_deleted), m_growth_limit(hash_map.m_growth_limit), m_max_load_factor(hash_map.m_max_load_factor), m_shrink_load_factor(hash_map.m_shrink_load_factor), m_old_data(hash_map.m_old_data), m_old_control(hash_map.m_old_control), m_old_occupancy(hash_map.m_old_occupancy), m_old_capacity(hash_map.m_old_capacity), m_migrated(hash_map.m_migrated), m_rehash_step(hash_map.m_rehash_step), m_allocator(hash_map.m_allocator), m_control_allocator(hash_map.m_control_allocator), m_occupancy_allocator(hash_map.m_occupancy_allocator), m_stats(hash_map.m_stats) {
+            hash_map.m_stats = TStats();
+            hash_map.m_data = nullptr;
+            hash_map.m_control = nullptr;
+            hash_map.m_occupancy = nullptr;
+            hash_map.m_count = 0;
+            hash_map.m_capacity = 0;
+            hash_map.m_deleted = 0;
+            hash_map.m_growth_limit = 0;
+            hash_map.m_old_data = nullptr;
+        }
+
+        ~HashMap() {
+            release();
+        }
+
+        template<typename... TArgs>
+        inline Reference emplace(const TKey& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            std::uint32_t hash_index = prepare_insert(hash_code);
+
+            m_data.construct(hash_index, hash_code, key, std::forward<TArgs>(args)...);
+            set_occupied(hash_index, HashGroup::tag(hash_code));
+
+            return m_data[hash_index];
+        }
+
+        // Inserts key, which must not be present, under the code THash gives
+        // it. Containers that keep hash codes use it to move elements into a
+        // HashMap without hashing them again.
+        template<typename... TArgs>
+        inline Iterator emplace_hashed(THashCode hash_code, const TKey& key, TArgs&&... args) {
+            std::uint32_t hash_index = prepare_insert(hash_code);
+
+            m_data.construct(hash_index, hash_code, key, std::forward<TArgs>(args)...);
+            set_occupied(hash_index, HashGroup::tag(hash_code));
+
+            return Iterator(m_data, m_occupancy, hash_index, m_capacity);
+        }
+
+        inline Reference insert(const TKey& key, const TValue& value ) {
+            THashCode hash_code = THash::hash_code(key);
+            std::uint32_t hash_index = prepare_insert(hash_code);
+
+            m_data.construct(hash_index, hash_code, key, std::move(value));
+            set_occupied(hash_index, HashGroup::tag(hash_code));
+
+            return m_data[hash_index];
+        }
+
+        // Inserts every pair of [first, last) without checking for duplicates,
+        // as insert does. A range whose length is known up front grows the
+        // table at most once.
+        template<typename TIterator, typename std::enable_if<!std::is_convertible<TIterator, TKey>::value, std::nullptr_t>::type = nullptr>
+        inline void insert(TIterator first, TIterator last) {
+            if constexpr (IsRandomAccessIterator<TIterator>::value) {
+                reserve(m_count + static_cast<std::uint32_t>(last - first));
+            }
+            for (; first != last; ++first) {
+                auto&& pair = *first;
+                emplace(pair.first, pair.second);
+            }
+        }
+
+        // Builds from [first, last) on thread_count threads. Each thread owns
+        // a run of slots, a whole number of occupancy words wide, and places
+        // the pairs whose home slot falls in its run. The pairs are first
+        // bucketed by owning run with a counting sort, so each thread only
+        // walks its own. Pairs whose probe would leave the run are placed by
+        // the calling thread afterwards. Duplicates are not checked, as with
+        // insert.
+        template<typename TIterator>
+        inline void insert_parallel(TIterator first, TIterator last, std::uint32_t thread_count = std::thread::hardware_concurrency()) {
+            static_assert(IsRandomAccessIterator<TIterator>::value, "insert_parallel requires random access iterators");
+
+            std::uint32_t count = static_cast<std::uint32_t>(last - first);
+            reserve(m_count + count);
+            finish_rehash();
+
+            std::uint32_t words = occupancy_size(m_capacity);
+            thread_count = std::clamp(thread_count, 1u, words);
+
+            auto run_begin = [&](std::uint32_t thread) {
+                return static_cast<std::uint32_t>(std::min<std::uint64_t>(static_cast<std::uint64_t>(words) * thread / thread_count * 64, m_capacity));
+            };
+            auto run_owner = [&](std::uint32_t hash_index) {
+                return static_cast<std::uint32_t>(((static_cast<std::uint64_t>(hash_index / 64) + 1) * thread_count - 1) / words);
+            };
+            auto input_begin = [&](std::uint32_t thread) {
+                return static_cast<std::uint32_t>(static_cast<std::uint64_t>(count) * thread / thread_count);
+            };
+
+            std::unique_ptr<THashCode[]> hash_codes(new THashCode[count]);
+            std::unique_ptr<std::uint32_t[]> hash_indices(new std::uint32_t[count]);
+            std::unique_ptr<std::uint32_t[]> order(new std::uint32_t[count]);
+            std::unique_ptr<std::uint32_t[]> offsets(new std::uint32_t[thread_count * thread_count]());
+            std::unique_ptr<std::uint32_t[]> buckets(new std::uint32_t[thread_count + 1]);
+            std::unique_ptr<std::uint32_t[]> deferred(new std::uint32_t[thread_count]);
+            std::unique_ptr<std::uint32_t[]> placed(new std::uint32_t[thread_count]);
+            std::unique_ptr<std::uint32_t[]> reused(new std::uint32_t[thread_count]);
+
+            // offsets[thread * thread_count + owner] counts the pairs of
+            // thread's input slice that owner places, then becomes where
+            // they go in order.
+            run_parallel(thread_count, [&](std::uint32_t thread) {
+                std::uint32_t* thread_offsets = offsets.get() + thread * thread_count;
+                for (std::uint32_t i = input_begin(thread); i < input_begin(thread + 1); i++) {
+                    hash_codes[i] = THash::hash_code((*(first + i)).first);
+                    hash_indices[i] = THashIndex::hash_index(hash_codes[i], m_capacity);
+                    thread_offsets[run_owner(hash_indices[i])]++;
+                }
+            });
+
+            std::uint32_t offset = 0;
+            for (std::uint32_t owner = 0; owner < thread_count; owner++) {
+                buckets[owner] = offset;
+                for (std::uint32_t thread = 0; thread < thread_count; thread++) {
+                    std::uint32_t size = offsets[thread * thread_count + owner];
+                    offsets[thread * thread_count + owner] = offset;
+                    offset += size;
+                }
+            }
+            buckets[thread_count] = offset;
+
+            run_parallel(thread_count, [&](std::uint32_t thread) {
+                std::uint32_t* thread_offsets = offsets.get() + thread * thread_count;
+                for (std::uint32_t i = input_begin(thread); i < input_begin(thread + 1); i++) {
+                    order[thread_offsets[run_owner(hash_indices[i])]++] = i;
+                }
+            });
+
+            // Deferred pairs are moved to the front of their thread's bucket.
+            run_parallel(thread_count, [&](std::uint32_t thread) {
+                std::uint32_t end = run_begin(thread + 1);
+                std::uint32_t thread_deferred = 0;
+                std::uint32_t thread_placed = 0;
+                std::uint32_t thread_reused = 0;
+
+                for (std::uint32_t j = buckets[thread]; j < buckets[thread + 1]; j++) {
+                    std::uint32_t i = order[j];
+                    std::uint32_t hash_index = hash_indices[i];
+                    while (hash_index != end && m_control[hash_index] >= 0) {
+                        hash_index++;
+                    }
+                    if (hash_index == end) {
+                        order[buckets[thread] + thread_deferred++] = i;
+                        continue;
+                    }
+                    if (m_control[hash_index] == HashGroup::DELETED) {
+                        thread_reused++;
+                    }
+                    auto&& pair = *(first + i);
+                    m_data.construct(hash_index, hash_codes[i], pair.first, pair.second);
+                    set_occupied(hash_index, HashGroup::tag(hash_codes[i]));
+                    thread_placed++;
+                }
+                deferred[thread] = thread_deferred;
+                placed[thread] = thread_placed;
+                reused[thread] = thread_reused;
+            });
+
+            for (std::uint32_t thread = 0; thread < thread_count; thread++) {
+                m_count += placed[thread];
+                m_deleted -= reused[thread];
+            }
+            for (std::uint32_t thread = 0; thread < thread_count; thread++) {
+                for (std::uint32_t j = buckets[thread]; j < buckets[thread] + deferred[thread]; j++) {
+                    std::uint32_t i = order[j];
+                    auto&& pair = *(first + i);
+                    std::uint32_t hash_index = prepare_insert(hash_codes[i]);
+                    m_data.construct(hash_index, hash_codes[i], pair.first, pair.second);
+                    set_occupied(hash_index, HashGroup::tag(hash_codes[i]));
+                }
+            }
+        }
+
+        template<typename... TArgs>
+        inline std::pair<Iterator, bool> try_emplace(const TKey& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            auto [hash_index, inserted] = find_or_prepare_insert(key, hash_code);
+
+            if (inserted) {
+                m_data.construct(hash_index, hash_code, key, std::forward<TArgs>(args)...);
+                set_occupied(hash_index, HashGroup::tag(hash_code));
+            }
+
+            return { Iterator(m_data, m_occupancy, hash_index, m_capacity), inserted };
+        }
+
+        template<typename TArg>
+        inline std::pair<Iterator, bool> insert_or_assign(const TKey& key, TArg&& value) {
+            THashCode hash_code = THash::hash_code(key);
+            auto [hash_index, inserted] = find_or_prepare_insert(key, hash_code);
+
+            if (inserted) {
+                m_data.construct(hash_index, hash_code, key, std::forward<TArg>(value));
+                set_occupied(hash_index, HashGroup::tag(hash_code));
+            }
+            else {
+                m_data[hash_index].get_value() = std::forward<TArg>(value);
+            }
+
+            return { Iterator(m_data, m_occupancy, hash_index, m_capacity), inserted };
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value && !std::is_same<TLookup, TKey>::value, std::nullptr_t>::type = nullptr, typename... TArgs>
+        inline std::pair<Iterator, bool> try_emplace(const TLookup& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            auto [hash_index, inserted] = find_or_prepare_insert(key, hash_code);
+
+            if (inserted) {
+                m_data.construct(hash_index, hash_code, TKey(key), std::forward<TArgs>(args)...);
+                set_occupied(hash_index, HashGroup::tag(hash_code));
+            }
+
+            return { Iterator(m_data, m_occupancy, hash_index, m_capacity), inserted };
+        }
+
+        // As try_emplace, but on insertion the key stored is make_key(key)
+        // rather than a copy of key, so a container can keep keys that refer
+        // to storage it owns and still probe only once.
+        template<typename TLookup, typename TMakeKey, typename... TArgs>
+        inline std::pair<Iterator, bool> try_emplace_with(const TLookup& key, TMakeKey&& make_key, TArgs&&... args) {
+            static_assert(std::is_same<TLookup, TKey>::value || IsTransparentHash<THash>::value, "try_emplace_with requires the key type or a transparent hash");
+
+            THashCode hash_code = THash::hash_code(key);
+            auto [hash_index, inserted] = find_or_prepare_insert(key, hash_code);
+
+            if (inserted) {
+                m_data.construct(hash_index, hash_code, make_key(key), std::forward<TArgs>(args)...);
+                set_occupied(hash_index, HashGroup::tag(hash_code));
+            }
+
+            return { Iterator(m_data, m_occupancy, hash_index, m_capacity), inserted };
+        }
+
+        inline Iterator find(const TKey& key) {
+            return make_iterator(locate(key, THash::hash_code(key)));
+        }
+
+        inline ConstIterator find(const TKey& key) const {
+            return make_iterator(locate(key, THash::hash_code(key)));
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Iterator find(const TLookup& key) {
+            return make_iterator(locate(key, THash::hash_code(key)));
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstIterator find(const TLookup& key) const {
+            return make_iterator(locate(key, THash::hash_code(key)));
+        }
+
+        // As find, under the code THash gives key, for containers that have
+        // hashed key already.
+        template<typename TLookup>
+        inline Iterator find_hashed(THashCode hash_code, const TLookup& key) {
+            static_assert(std::is_same<TLookup, TKey>::value || IsTransparentHash<THash>::value, "find_hashed requires the key type or a transparent hash");
+            return make_iterator(locate(key, hash_code));
+        }
+
+        template<typename TLookup>
+        inline ConstIterator find_hashed(THashCode hash_code, const TLookup& key) const {
+            static_assert(std::is_same<TLookup, TKey>::value || IsTransparentHash<THash>::value, "find_hashed requires the key type or a transparent hash");
+            return make_iterator(locate(key, hash_code));
+        }
+
+        inline bool contains(const TKey& key) const {
+            return locate(key, THash::hash_code(key)).first != NOT_FOUND;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return locate(key, THash::hash_code(key)).first != NOT_FOUND;
+        }
+
+        // Every node with the given key, for maps that hold duplicates. The
+        // range refers to key, which must outlive it.
+        inline EqualRange<EqualIterator<TKey, Reference, Pointer>> equal_range(const TKey& key) {
+            return make_equal_range<TKey, Reference, Pointer>(key);
+        }
+
+        inline EqualRange<EqualIterator<TKey, ConstReference, ConstPointer>> equal_range(const TKey& key) const {
+            return make_equal_range<TKey, ConstReference, ConstPointer>(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline EqualRange<EqualIterator<TLookup, Reference, Pointer>> equal_range(const TLookup& key) {
+            return make_equal_range<TLookup, Reference, Pointer>(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline EqualRange<EqualIterator<TLookup, ConstReference, ConstPointer>> equal_range(const TLookup& key) const {
+            return make_equal_range<TLookup, ConstReference, ConstPointer>(key);
+        }
+
+        // Removes every node with the given key and returns how many there were.
+        inline std::uint32_t remove_all(const TKey& key) {
+            return erase_all(key, THash::hash_code(key));
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline std::uint32_t remove_all(const TLookup& key) {
+            return erase_all(key, THash::hash_code(key));
+        }
+
+        // Batched entry points hash a run of BATCH_SIZE keys and prefetch their
+        // home groups before probing any of them, so the cache misses of the
+        // run overlap instead of being paid one after the other. Keys that are
+        // missing yield nullptr.
+        inline void find_batch(std::span<const TKey> keys, std::span<Pointer> nodes) {
+            find_batch_nodes(keys, nodes);
+        }
+
+        inline void find_batch(std::span<const TKey> keys, std::span<ConstPointer> nodes) const {
+            find_batch_nodes(keys, nodes);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void find_batch(std::span<const TLookup> keys, std::span<Pointer> nodes) {
+            find_batch_nodes(keys, nodes);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void find_batch(std::span<const TLookup> keys, std::span<ConstPointer> nodes) const {
+            find_batch_nodes(keys, nodes);
+        }
+
+        inline void emplace_batch(std::span<const TKey> keys, std::span<const TValue> values) {
+            assert(values.size() >= keys.size());
+            THashCode hash_codes[BATCH_SIZE];
+
+            for (std::size_t first = 0; first < keys.size(); first += BATCH_SIZE) {
+                std::uint32_t count = static_cast<std::uint32_t>(std::min<std::size_t>(BATCH_SIZE, keys.size() - first));
+                prepare_batch(count);
+
+                for (std::uint32_t i = 0; i < count; i++) {
+                    hash_codes[i] = THash::hash_code(keys[first + i]);
+                    prefetch_slot(hash_codes[i]);
+                }
+                for (std::uint32_t i = 0; i < count; i++) {
+                    std::uint32_t hash_index = prepare_insert(hash_codes[i]);
+
+                    m_data.construct(hash_index, hash_codes[i], keys[first + i], values[first + i]);
+                    set_occupied(hash_index, HashGroup::tag(hash_codes[i]));
+                }
+            }
+        }
+
+        inline HashMap& operator = (HashMap&& hash_map) {
+            if (this != &hash_map) {
+                release();
+                m_data = hash_map.m_data;
+                m_control = hash_map.m_control;
+                m_occupancy = hash_map.m_occupancy;
+                m_count = hash_map.m_count;
+                m_capacity = hash_map.m_capacity;
+                m_deleted = hash_map.m_deleted;
+                m_growth_limit = hash_map.m_growth_limit;
+                m_max_load_factor = hash_map.m_max_load_factor;
+                m_shrink_load_factor = hash_map.m_shrink_load_factor;
+                m_old_data = hash_map.m_old_data;
+                m_old_control = hash_map.m_old_control;
+                m_old_occupancy = hash_map.m_old_occupancy;
+                m_old_capacity = hash_map.m_old_capacity;
+                m_migrated = hash_map.m_migrated;
+                m_rehash_step = hash_map.m_rehash_step;
+                m_stats = hash_map.m_stats;
+
+                hash_map.m_stats = TStats();
+                hash_map.m_data = nullptr;
+                hash_map.m_control = nullptr;
+                hash_map.m_occupancy = nullptr;
+                hash_map.m_count = 0;
+                hash_map.m_capacity = 0;
+                hash_map.m_deleted = 0;
+                hash_map.m_growth_limit = 0;
+                hash_map.m_old_data = nullptr;
+            }
+
+            return *this;
+        }
+
+        inline Reference operator [] (const TKey& key) {
+            Pointer node = find_node(key, THash::hash_code(key));
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        inline ConstReference operator [] (const TKey& key) const {
+            ConstPointer node = find_node(key, THash::hash_code(key));
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        inline void remove(const TKey& key) {
+            erase_node(key, THash::hash_code(key));
+        }
+
+        // Removes the node stored under key, if any, with a single probe under
+        // the code THash gives key, and returns whether there was one.
+        template<typename TLookup>
+        inline bool erase_hashed(THashCode hash_code, const TLookup& key) {
+            static_assert(std::is_same<TLookup, TKey>::value || IsTransparentHash<THash>::value, "erase_hashed requires the key type or a transparent hash");
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+            }
+            std::pair<std::uint32_t, bool> location = locate(key, hash_code);
+            if (location.first == NOT_FOUND) {
+                return false;
+            }
+            erase_location(location);
+            shrink_if_sparse();
+
+            return true;
+        }
+
+        // Moves the node stored under key out of the map. The handle is empty
+        // when the key is missing.
+        inline NodeHandle extract(const TKey& key) {
+            return extract_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline NodeHandle extract(const TLookup& key) {
+            return extract_node(key);
+        }
+
+        // Inserts the node of handle unless its key is already present, in
+        // which case the handle keeps it. The stored hash code is reused.
+        inline std::pair<Iterator, bool> insert(NodeHandle&& handle) {
+            assert(!handle.is_empty());
+            THashCode hash_code = handle.get_hash_code();
+            auto [hash_index, inserted] = find_or_prepare_insert(handle.get_key(), hash_code);
+            if (inserted) {
+                m_data.insert(hash_index, std::move(handle.m_node));
+                set_occupied(hash_index, HashGroup::tag(hash_code));
+                handle.reset();
+            }
+            return { Iterator(m_data, m_occupancy, hash_index, m_capacity), inserted };
+        }
+
+        // Moves every node of hash_map whose key is not present here, reusing
+        // its hash code. Nodes with keys already present stay in hash_map.
+        inline void merge(HashMap& hash_map) {
+            assert(&hash_map != this);
+            hash_map.finish_rehash();
+            prepare_batch(hash_map.m_count);
+
+            Bitset<64>* occupancy = hash_map.m_occupancy;
+            std::uint32_t capacity = hash_map.m_capacity;
+            for (std::uint32_t i = next_occupied(occupancy, 0, capacity); i != capacity; i = next_occupied(occupancy, i + 1, capacity)) {
+                THashCode hash_code = hash_map.m_data.get_hash_code(i);
+                auto [hash_index, inserted] = find_or_prepare_insert(hash_map.m_data.get_key(i), hash_code);
+                if (inserted) {
+                    m_data.relocate(hash_index, hash_map.m_data, i);
+                    set_occupied(hash_index, HashGroup::tag(hash_code));
+                    hash_map.vacate_index(i);
+                }
+            }
+            if (hash_map.m_count == 0) {
+                hash_map.clear();
+            }
+            else {
+                hash_map.shrink_if_sparse();
+            }
+        }
+
+        // Removes every node predicate accepts in a single pass over the slots
+        // and returns how many there were. A sweep that leaves more tombstones
+        // than elements rebuilds the table at the same capacity, clearing them
+        // all at once.
+        template<typename TPredicate>
+        inline std::uint32_t erase_if(TPredicate&& predicate) {
+            std::uint32_t count = m_count;
+            if (m_old_data != nullptr) {
+                for (std::uint32_t i = next_occupied(m_old_occupancy, m_migrated, m_old_capacity); i != m_old_capacity; i = next_occupied(m_old_occupancy, i + 1, m_old_capacity)) {
+                    if (predicate(m_old_data[i])) {
+                        erase_location({ i, true });
+                    }
+                }
+            }
+            for (std::uint32_t i = next_occupied(m_occupancy, 0, m_capacity); i != m_capacity; i = next_occupied(m_occupancy, i + 1, m_capacity)) {
+                if (predicate(m_data[i])) {
+                    erase_index(i);
+                }
+            }
+            shrink_if_sparse();
+            if (m_deleted > m_count) {
+                resize(m_capacity);
+            }
+            return count - m_count;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Reference operator [] (const TLookup& key) {
+            Pointer node = find_node(key, THash::hash_code(key));
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstReference operator [] (const TLookup& key) const {
+            ConstPointer node = find_node(key, THash::hash_code(key));
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            erase_node(key, THash::hash_code(key));
+        }
+
+        inline void clear() {
+            if (m_old_data != nullptr) {
+                destroy_nodes(m_old_data, m_old_occupancy, m_old_capacity);
+                deallocate(m_old_data, m_old_control, m_old_occupancy, m_old_capacity);
+                m_old_data = nullptr;
+            }
+            destroy_nodes(m_data, m_occupancy, m_capacity);
+            clear_control();
+            m_count = 0;
+            m_deleted = 0;
+            shrink_if_sparse();
+        }
+
+        // Grows the table so it holds count elements without another rehash.
+        inline void reserve(std::uint32_t count) {
+            if (count > m_count) {
+                prepare_batch(count - m_count);
+            }
+        }
+
+        inline void set_max_load_factor(float max_load_factor) {
+            assert(max_load_factor > 0.0f && max_load_factor <= 1.0f);
+            assert(m_shrink_load_factor < max_load_factor / 4);
+            m_max_load_factor = max_load_factor;
+            m_growth_limit = growth_limit(m_capacity);
+
+            std::uint32_t capacity = m_capacity;
+            while (m_count >= growth_limit(capacity)) {
+                capacity *= 2;
+            }
+            if (capacity != m_capacity) {
+                resize(capacity);
+            }
+        }
+
+        // Rebuilds the table at the smallest capacity that holds count
+        // elements, and at least the current ones, under the max load factor.
+        // Tombstones are dropped, and the table may shrink.
+        inline void rehash(std::uint32_t count) {
+            resize(fit_capacity(std::max(count, m_count)));
+        }
+
+        // Gives memory back once removals have left the table sparse.
+        inline void shrink_to_fit() {
+            std::uint32_t capacity = fit_capacity(m_count);
+            if (capacity < m_capacity) {
+                resize(capacity);
+            }
+        }
+
+        // With a non-zero factor, a removal or clear() that leaves the load
+        // factor below it shrinks the table to about half the max load
+        // factor, leaving room both ways so it doesn't grow or shrink again
+        // right away. The factor must stay below a quarter of the max load
+        // factor for the table not to land under it right after shrinking.
+        // A factor of 0, the default, never shrinks.
+        inline void set_shrink_load_factor(float shrink_load_factor) {
+            assert(shrink_load_factor >= 0.0f && shrink_load_factor < m_max_load_factor / 4);
+            m_shrink_load_factor = shrink_load_factor;
+            shrink_if_sparse();
+        }
+
+        inline float get_shrink_load_factor() const {
+            return m_shrink_load_factor;
+        }
+
+        // With a non-zero step, growing keeps the previous table alive and
+        // every mutating operation moves up to step elements out of it, so no
+        // single insertion pays for the whole rehash. Lookups check both
+        // tables until the old one is drained. A step of 0 rehashes at once.
+        inline void set_rehash_step(std::uint32_t rehash_step) {
+            m_rehash_step = rehash_step;
+            if (m_rehash_step == 0) {
+                finish_rehash();
+            }
+        }
+
+        inline void finish_rehash() {
+            migrate(std::numeric_limits<std::uint32_t>::max());
+        }
+
+        // Returns a copy at the same capacity and load factors. Control bytes
+        // and occupancy are copied as they are and every slot is copied in
+        // place, so no key is hashed or compared. Elements still in a table
+        // being drained are placed by their stored hash code.
+        inline HashMap clone() const {
+            HashMap hash_map(m_capacity);
+            hash_map.m_count = m_count;
+            hash_map.m_deleted = m_deleted;
+            hash_map.m_growth_limit = m_growth_limit;
+            hash_map.m_max_load_factor = m_max_load_factor;
+            hash_map.m_shrink_load_factor = m_shrink_load_factor;
+            hash_map.m_rehash_step = m_rehash_step;
+            std::memcpy(hash_map.m_control, m_control, control_size(m_capacity));
+            std::copy(m_occupancy, m_occupancy + occupancy_size(m_capacity), hash_map.m_occupancy);
+            for (std::uint32_t i = next_occupied(m_occupancy, 0, m_capacity); i != m_capacity; i = next_occupied(m_occupancy, i + 1, m_capacity)) {
+                hash_map.m_data.copy(i, m_data, i);
+            }
+
+            if (m_old_data != nullptr) {
+                for (std::uint32_t i = next_occupied(m_old_occupancy, 0, m_old_capacity); i != m_old_capacity; i = next_occupied(m_old_occupancy, i + 1, m_old_capacity)) {
+                    std::uint32_t hash_index = hash_map.find_empty_index(m_old_data.get_hash_code(i));
+                    if (hash_map.m_control[hash_index] == HashGroup::DELETED) {
+                        hash_map.m_deleted--;
+                    }
+                    hash_map.m_data.copy(hash_index, m_old_data, i);
+                    hash_map.set_occupied(hash_index, m_old_control[i]);
+                }
+            }
+
+            return hash_map;
+        }
+
+        inline bool is_rehashing() const {
+            return m_old_data != nullptr;
+        }
+
+        inline std::uint32_t get_rehash_step() const {
+            return m_rehash_step;
+        }
+
+        inline float get_max_load_factor() const {
+            return m_max_load_factor;
+        }
+
+        inline float get_load_factor() const {
+            return static_cast<float>(m_count) / m_capacity;
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_count;
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_capacity;
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline HashStats get_stats() const {
+            HashStats stats = m_stats.get_stats();
+            stats.count = m_count;
+            stats.capacity = m_capacity;
+            stats.deleted = m_deleted;
+            stats.max_cluster_length = cluster_length();
+            stats.load_factor = get_load_factor();
+
+            return stats;
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline void reset_stats() {
+            m_stats.reset();
+        }
+
+        Iterator begin() {
+            if (m_old_data != nullptr) {
+                return Iterator(m_old_data, m_old_occupancy, next_occupied(m_old_occupancy, m_migrated, m_old_capacity), m_old_capacity, m_data, m_occupancy, m_capacity);
+            }
+            return Iterator(m_data, m_occupancy, next_occupied(m_occupancy, 0, m_capacity), m_capacity);
+        }
+
+        Iterator end() {
+            return Iterator(m_data, m_occupancy, m_capacity, m_capacity);
+        }
+
+        ConstIterator begin() const {
+            return cbegin();
+        }
+
+        ConstIterator end() const {
+            return cend();
+        }
+
+        ConstIterator cbegin() const {
+            if (m_old_data != nullptr) {
+                return ConstIterator(m_old_data, m_old_occupancy, next_occupied(m_old_occupancy, m_migrated, m_old_capacity), m_old_capacity, m_data, m_occupancy, m_capacity);
             }
-            auto* data = m_head;
-            while (!data->get_hash_code()) {
-                data--;
+            return ConstIterator(m_data, m_occupancy, next_occupied(m_occupancy, 0, m_capacity), m_capacity);
+        }
+
+        ConstIterator cend() const {
+            return ConstIterator(m_data, m_occupancy, m_capacity, m_capacity);
+        }
+
+        ReverseIterator rbegin() {
+            return ReverseIterator(m_data, m_occupancy, previous_occupied(m_occupancy, m_capacity), m_old_data, m_old_occupancy, m_old_capacity);
+        }
+
+        ReverseIterator rend() {
+            if (m_old_data != nullptr) {
+                return ReverseIterator(m_old_data, m_old_occupancy, 0);
             }
-            return ConstReverseIterator(data, m_data);
-        } 
+            return ReverseIterator(m_data, m_occupancy, 0);
+        }
+
+        ConstReverseIterator crbegin() const {
+            return ConstReverseIterator(m_data, m_occupancy, previous_occupied(m_occupancy, m_capacity), m_old_data, m_old_occupancy, m_old_capacity);
+        }
 
         ConstReverseIterator crend() const {
-            return ConstReverseIterator(m_data, m_data);
+            if (m_old_data != nullptr) {
+                return ConstReverseIterator(m_old_data, m_old_occupancy, 0);
+            }
+            return ConstReverseIterator(m_data, m_occupancy, 0);
         }
 
         HashMap (const HashMap&) = delete;
-        HashMap& operator= (const HashMap&) = default;
+        HashMap& operator= (const HashMap&) = delete;
 
     private:
-        inline void grow(std::uint32_t new_capacity) {
-            std::uint32_t old_capacity = m_capacity;
-            m_capacity = new_capacity;
-            HashNode<TKey, TValue>* tmp_data = m_data;
-            m_data = m_allocator.allocate(m_capacity);
-            m_head = m_data + m_capacity;
-            clear_hash_codes();
-
-            for (std::uint32_t i = 0; i < old_capacity; i++) {
-                if (tmp_data[i].get_hash_code()) {
-                    std::uint32_t hash_index = THashIndex::hash_index(tmp_data[i].get_hash_code(), m_capacity);
-                    while (m_data[hash_index].get_hash_code()) {
-                        if (++hash_index == m_capacity) {
-                            grow(m_capacity * 2);
-                            m_allocator.deallocate(tmp_data, old_capacity);
-                            return;
-                        }
+        static constexpr std::uint32_t NOT_FOUND = ~static_cast<std::uint32_t>(0);
+
+        // Bits are stored most significant first, as in Bitset, so the next
+        // occupied slot of a word is found with a leading-zero count.
+        static inline std::uint32_t next_occupied(const Bitset<64>* occupancy, std::uint32_t index, std::uint32_t capacity) {
+            if (index >= capacity) {
+                return capacity;
+            }
+            std::uint32_t word = index / 64;
+            std::uint64_t bits = occupancy[word].get_data() & (~static_cast<std::uint64_t>(0) >> (index % 64));
+
+            while (!bits) {
+                if (++word * 64 >= capacity) {
+                    return capacity;
+                }
+                bits = occupancy[word].get_data();
+            }
+            return word * 64 + std::countl_zero(bits);
+        }
+
+        // Returns one past the last occupied slot before index, or 0 if there is none.
+        static inline std::uint32_t previous_occupied(const Bitset<64>* occupancy, std::uint32_t index) {
+            if (index == 0) {
+                return 0;
+            }
+            index--;
+            std::uint32_t word = index / 64;
+            std::uint64_t bits = occupancy[word].get_data() & (~static_cast<std::uint64_t>(0) << (63 - index % 64));
+
+            while (!bits) {
+                if (word-- == 0) {
+                    return 0;
+                }
+                bits = occupancy[word].get_data();
+            }
+            return word * 64 + 64 - std::countr_zero(bits);
+        }
+
+        static constexpr std::uint32_t occupancy_size(std::uint32_t capacity) {
+            return capacity / 64 + 1;
+        }
+
+        static constexpr std::uint32_t round_capacity(std::uint32_t capacity) {
+            if (capacity < HashGroup::WIDTH) {
+                return HashGroup::WIDTH;
+            }
+            if constexpr (THashIndex::POWER_OF_TWO) {
+                return std::bit_ceil(capacity);
+            }
+            return capacity;
+        }
+
+        static constexpr std::uint64_t table_size(std::uint32_t capacity) {
+            return static_cast<std::uint64_t>(capacity) * Data::SLOT_SIZE + control_size(capacity) + occupancy_size(capacity) * sizeof(Bitset<64>);
+        }
+
+        static constexpr std::uint32_t control_size(std::uint32_t capacity) {
+            return capacity + HashGroup::WIDTH - 1;
+        }
+
+        static inline std::uint32_t wrap(std::uint32_t index, std::uint32_t capacity) {
+            if constexpr (THashIndex::POWER_OF_TWO) {
+                return index & (capacity - 1);
+            }
+            return (index >= capacity) ? index - capacity : index;
+        }
+
+        static inline void set_control(std::int8_t* control, std::uint32_t capacity, std::uint32_t index, std::int8_t tag) {
+            control[index] = tag;
+            if (index < HashGroup::WIDTH - 1) {
+                control[capacity + index] = tag;
+            }
+        }
+
+        // Probing walks the table one group at a time from the home slot and
+        // wraps around at the end. A lookup ends at the first group holding an
+        // EMPTY slot; removals leave DELETED tombstones so they don't cut
+        // probe sequences short, and the load factor, which counts tombstones,
+        // guarantees an EMPTY slot is always reached.
+        template<typename TLookup>
+        inline std::uint32_t probe(const TLookup& key, THashCode hash_code, Data data, const std::int8_t* control, std::uint32_t capacity) const {
+            std::int8_t tag = HashGroup::tag(hash_code);
+            std::uint32_t hash_index = THashIndex::hash_index(hash_code, capacity);
+
+            for (std::uint32_t length = 1; ; length++) {
+                HashGroup group(control + hash_index);
+                for (std::uint32_t match = group.match(tag); match; match &= match - 1) {
+                    std::uint32_t index = wrap(hash_index + std::countr_zero(match), capacity);
+                    m_stats.record_tag_match();
+                    if (data.get_hash_code(index) == hash_code && data.get_key(index) == key) {
+                        m_stats.record_probe(length);
+                        return index;
+                    }
+                }
+                if (group.match_empty()) {
+                    m_stats.record_probe(length);
+                    return capacity;
+                }
+                hash_index = wrap(hash_index + HashGroup::WIDTH, capacity);
+            }
+        }
+
+        // Returns the slot holding key, or NOT_FOUND, and whether that slot is
+        // in the table being drained.
+        template<typename TLookup>
+        inline std::pair<std::uint32_t, bool> locate(const TLookup& key, THashCode hash_code) const {
+            std::uint32_t hash_index = probe(key, hash_code, m_data, m_control, m_capacity);
+            if (hash_index != m_capacity) {
+                return { hash_index, false };
+            }
+            if (m_old_data != nullptr) {
+                hash_index = probe(key, hash_code, m_old_data, m_old_control, m_old_capacity);
+                if (hash_index != m_old_capacity) {
+                    return { hash_index, true };
+                }
+            }
+            return { NOT_FOUND, false };
+        }
+
+        template<typename TLookup>
+        inline Pointer find_node(const TLookup& key, THashCode hash_code) const {
+            auto [hash_index, old] = locate(key, hash_code);
+            if (hash_index == NOT_FOUND) {
+                return nullptr;
+            }
+            return old ? m_old_data.get_pointer(hash_index) : m_data.get_pointer(hash_index);
+        }
+
+        inline Iterator make_iterator(std::pair<std::uint32_t, bool> location) {
+            auto [hash_index, old] = location;
+            if (hash_index == NOT_FOUND) {
+                return end();
+            }
+            if (!old) {
+                return Iterator(m_data, m_occupancy, hash_index, m_capacity);
+            }
+            return Iterator(m_old_data, m_old_occupancy, hash_index, m_old_capacity, m_data, m_occupancy, m_capacity);
+        }
+
+        inline ConstIterator make_iterator(std::pair<std::uint32_t, bool> location) const {
+            auto [hash_index, old] = location;
+            if (hash_index == NOT_FOUND) {
+                return cend();
+            }
+            if (!old) {
+                return ConstIterator(m_data, m_occupancy, hash_index, m_capacity);
+            }
+            return ConstIterator(m_old_data, m_old_occupancy, hash_index, m_old_capacity, m_data, m_occupancy, m_capacity);
+        }
+
+        inline void prefetch_slot(THashCode hash_code) const {
+            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+            hash_prefetch(m_control + hash_index);
+            m_data.prefetch(hash_index);
+        }
+
+        template<typename TLookup, typename TPointer>
+        inline void find_batch_nodes(std::span<const TLookup> keys, std::span<TPointer> nodes) const {
+            assert(nodes.size() >= keys.size());
+            THashCode hash_codes[BATCH_SIZE];
+
+            for (std::size_t first = 0; first < keys.size(); first += BATCH_SIZE) {
+                std::uint32_t count = static_cast<std::uint32_t>(std::min<std::size_t>(BATCH_SIZE, keys.size() - first));
+
+                for (std::uint32_t i = 0; i < count; i++) {
+                    hash_codes[i] = THash::hash_code(keys[first + i]);
+                    prefetch_slot(hash_codes[i]);
+                }
+                for (std::uint32_t i = 0; i < count; i++) {
+                    nodes[first + i] = find_node(keys[first + i], hash_codes[i]);
+                }
+            }
+        }
+
+        // Grows the table up front when count more elements would cross the
+        // growth limit, so a batch is not interrupted by a rehash after its
+        // slots have been prefetched.
+        inline void prepare_batch(std::uint32_t count) {
+            if (m_count + m_deleted + count <= m_growth_limit) {
+                return;
+            }
+            std::uint32_t capacity = m_capacity;
+            while (m_count + count > growth_limit(capacity)) {
+                capacity *= 2;
+            }
+            resize(capacity);
+        }
+
+        // Runs function(thread) for every thread below thread_count, the
+        // first one on the calling thread.
+        template<typename TFunction>
+        static inline void run_parallel(std::uint32_t thread_count, const TFunction& function) {
+            std::unique_ptr<std::thread[]> threads(new std::thread[thread_count - 1]);
+            for (std::uint32_t thread = 1; thread < thread_count; thread++) {
+                threads[thread - 1] = std::thread(function, thread);
+            }
+            function(0);
+            for (std::uint32_t thread = 1; thread < thread_count; thread++) {
+                threads[thread - 1].join();
+            }
+        }
+
+        inline std::uint32_t find_empty_index(THashCode hash_code) const {
+            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+
+            for (std::uint32_t length = 1; ; length++) {
+                std::uint32_t empty = HashGroup(m_control + hash_index).match_empty_or_deleted();
+                if (empty) {
+                    m_stats.record_probe(length);
+                    return wrap(hash_index + std::countr_zero(empty), m_capacity);
+                }
+                hash_index = wrap(hash_index + HashGroup::WIDTH, m_capacity);
+            }
+        }
+
+        // Looks the key up and, when it is missing, reserves the slot it goes in
+        // from the same probe sequence. Only a rehash forces a second probe.
+        template<typename TLookup>
+        inline std::pair<std::uint32_t, bool> find_or_prepare_insert(const TLookup& key, THashCode hash_code) {
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+                if (m_old_data != nullptr) {
+                    std::uint32_t old_index = probe(key, hash_code, m_old_data, m_old_control, m_old_capacity);
+                    if (old_index != m_old_capacity) {
+                        return { migrate_index(old_index), false };
+                    }
+                }
+            }
+
+            std::int8_t tag = HashGroup::tag(hash_code);
+            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+            std::uint32_t insert_index = m_capacity;
+
+            for (std::uint32_t length = 1; ; length++) {
+                HashGroup group(m_control + hash_index);
+                for (std::uint32_t match = group.match(tag); match; match &= match - 1) {
+                    std::uint32_t index = wrap(hash_index + std::countr_zero(match), m_capacity);
+                    m_stats.record_tag_match();
+                    if (m_data.get_hash_code(index) == hash_code && m_data.get_key(index) == key) {
+                        m_stats.record_probe(length);
+                        return { index, false };
+                    }
+                }
+                if (insert_index == m_capacity) {
+                    std::uint32_t available = group.match_empty_or_deleted();
+                    if (available) {
+                        insert_index = wrap(hash_index + std::countr_zero(available), m_capacity);
                     }
-                    std::construct_at(m_data + hash_index, std::move(tmp_data[i]));
-                    std::destroy_at(tmp_data + i);
+                }
+                if (group.match_empty()) {
+                    m_stats.record_probe(length);
+                    break;
+                }
+                hash_index = wrap(hash_index + HashGroup::WIDTH, m_capacity);
+            }
+
+            if (m_count + m_deleted >= m_growth_limit) {
+                return { prepare_insert(hash_code), true };
+            }
+            if (m_control[insert_index] == HashGroup::DELETED) {
+                m_deleted--;
+            }
+            m_count++;
+
+            return { insert_index, true };
+        }
+
+        // Makes room for one more element and returns the slot it goes in.
+        // When tombstones take up most of the growth budget the table is
+        // rehashed at the same capacity instead of growing.
+        inline std::uint32_t prepare_insert(THashCode hash_code) {
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+            }
+            if (m_count + m_deleted >= m_growth_limit) {
+                resize((m_count < m_growth_limit / 2) ? m_capacity : m_capacity * 2);
+            }
+            std::uint32_t hash_index = find_empty_index(hash_code);
+            if (m_control[hash_index] == HashGroup::DELETED) {
+                m_deleted--;
+            }
+            m_count++;
+
+            return hash_index;
+        }
+
+        template<typename TLookup>
+        inline void erase_node(const TLookup& key, THashCode hash_code) {
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+            }
+            std::pair<std::uint32_t, bool> location = locate(key, hash_code);
+            assert(location.first != NOT_FOUND);
+
+            erase_location(location);
+            shrink_if_sparse();
+        }
+
+        template<typename TLookup>
+        inline std::uint32_t erase_all(const TLookup& key, THashCode hash_code) {
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+            }
+            std::uint32_t count = 0;
+            for (std::pair<std::uint32_t, bool> location = locate(key, hash_code); location.first != NOT_FOUND; location = locate(key, hash_code)) {
+                erase_location(location);
+                count++;
+            }
+            shrink_if_sparse();
+            return count;
+        }
+
+        // Slots of the table being drained always become tombstones, as it
+        // takes no more insertions.
+        inline void erase_location(std::pair<std::uint32_t, bool> location) {
+            auto [hash_index, old] = location;
+            if (!old) {
+                return erase_index(hash_index);
+            }
+            m_old_data.destroy(hash_index);
+            vacate_old_index(hash_index);
+        }
+
+        inline void vacate_old_index(std::uint32_t index) {
+            m_old_occupancy[index / 64].unset_bit(index % 64);
+            set_control(m_old_control, m_old_capacity, index, HashGroup::DELETED);
+            m_count--;
+        }
+
+        template<typename TLookup>
+        inline NodeHandle extract_node(const TLookup& key) {
+            if (m_old_data != nullptr) {
+                migrate(m_rehash_step);
+            }
+            NodeHandle handle;
+            auto [hash_index, old] = locate(key, THash::hash_code(key));
+            if (hash_index == NOT_FOUND) {
+                return handle;
+            }
+            if (old) {
+                m_old_data.extract(hash_index, &handle.m_node);
+                vacate_old_index(hash_index);
+            }
+            else {
+                m_data.extract(hash_index, &handle.m_node);
+                vacate_index(hash_index);
+            }
+            handle.m_empty = false;
+            shrink_if_sparse();
+
+            return handle;
+        }
+
+        template<typename TLookup, typename TReference, typename TPointer>
+        inline EqualRange<EqualIterator<TLookup, TReference, TPointer>> make_equal_range(const TLookup& key) const {
+            THashCode hash_code = THash::hash_code(key);
+            return EqualIterator<TLookup, TReference, TPointer>(key, hash_code, m_data, m_control, m_capacity, m_old_data, m_old_control, m_old_capacity);
+        }
+
+        inline void erase_index(std::uint32_t index) {
+            m_data.destroy(index);
+            vacate_index(index);
+        }
+
+        // Frees the slot at index once its node has been destroyed or moved
+        // out. A slot can go straight back to EMPTY when every group window
+        // that covers it also covers an EMPTY slot, since no probe sequence
+        // can have passed over it.
+        inline void vacate_index(std::uint32_t index) {
+            m_occupancy[index / 64].unset_bit(index % 64);
+            m_count--;
+
+            std::uint32_t empty_before = HashGroup(m_control + wrap(index + m_capacity - HashGroup::WIDTH, m_capacity)).match_empty();
+            std::uint32_t empty_after = HashGroup(m_control + index).match_empty();
+            if (empty_before && empty_after && static_cast<std::uint32_t>(std::countr_zero(empty_after) + std::countl_zero(static_cast<std::uint16_t>(empty_before))) < HashGroup::WIDTH) {
+                set_control(m_control, m_capacity, index, HashGroup::EMPTY);
+            }
+            else {
+                set_control(m_control, m_capacity, index, HashGroup::DELETED);
+                m_deleted++;
+            }
+        }
+
+        // Walks the current table once, starting from an EMPTY slot so runs
+        // that wrap around the end are measured whole. The load factor keeps
+        // at least one slot EMPTY.
+        inline std::uint32_t cluster_length() const {
+            std::uint32_t first = 0;
+            while (m_control[first] != HashGroup::EMPTY) {
+                first++;
+            }
+            std::uint32_t longest = 0;
+            std::uint32_t length = 0;
+            for (std::uint32_t i = 1; i <= m_capacity; i++) {
+                if (m_control[wrap(first + i, m_capacity)] == HashGroup::EMPTY) {
+                    longest = std::max(longest, length);
+                    length = 0;
+                }
+                else {
+                    length++;
+                }
+            }
+            return longest;
+        }
+
+        inline std::uint32_t growth_limit(std::uint32_t capacity) const {
+            std::uint32_t limit = static_cast<std::uint32_t>(capacity * m_max_load_factor);
+            return (limit < capacity) ? limit : capacity - 1;
+        }
+
+        // The smallest capacity that takes count elements without growing.
+        inline std::uint32_t fit_capacity(std::uint32_t count) const {
+            std::uint32_t capacity = round_capacity(static_cast<std::uint32_t>(count / m_max_load_factor));
+            while (count >= growth_limit(capacity)) {
+                capacity = round_capacity(capacity + 1);
+            }
+            return capacity;
+        }
+
+        inline void shrink_if_sparse() {
+            if (m_count < m_capacity * m_shrink_load_factor) {
+                std::uint32_t capacity = fit_capacity(m_count * 2);
+                if (capacity < m_capacity) {
+                    resize(capacity);
                 }
             }
-            m_allocator.deallocate(tmp_data, old_capacity);
         }
 
-        inline void clear_hash_codes() {
-            for (std::uint32_t i = 0; i < m_capacity; i++) {
-                m_data[i].set_hash_code(0);
-            } 
+        inline void set_occupied(std::uint32_t index, std::int8_t tag) {
+            set_control(m_control, m_capacity, index, tag);
+            m_occupancy[index / 64].set_bit(index % 64);
+        }
+
+        inline void resize(std::uint32_t new_capacity) {
+            m_stats.begin_rehash();
+            bool grown = new_capacity > m_capacity;
+            finish_rehash();
+
+            m_old_data = m_data;
+            m_old_control = m_control;
+            m_old_occupancy = m_occupancy;
+            m_old_capacity = m_capacity;
+            m_migrated = 0;
+            m_capacity = new_capacity;
+            allocate();
+
+            if (m_rehash_step == 0) {
+                finish_rehash();
+            }
+            m_stats.end_rehash(grown);
+        }
+
+        // Moves up to count elements out of the table being drained, and
+        // releases it once it is empty.
+        inline void migrate(std::uint32_t count) {
+            while (m_old_data != nullptr) {
+                m_migrated = next_occupied(m_old_occupancy, m_migrated, m_old_capacity);
+                if (m_migrated == m_old_capacity) {
+                    deallocate(m_old_data, m_old_control, m_old_occupancy, m_old_capacity);
+                    m_old_data = nullptr;
+                    return;
+                }
+                if (count-- == 0) {
+                    return;
+                }
+                migrate_index(m_migrated);
+            }
+        }
+
+        inline std::uint32_t migrate_index(std::uint32_t old_index) {
+            std::uint32_t hash_index = find_empty_index(m_old_data.get_hash_code(old_index));
+            if (m_control[hash_index] == HashGroup::DELETED) {
+                m_deleted--;
+            }
+            m_data.relocate(hash_index, m_old_data, old_index);
+            set_occupied(hash_index, m_old_control[old_index]);
+
+            m_old_occupancy[old_index / 64].unset_bit(old_index % 64);
+            set_control(m_old_control, m_old_capacity, old_index, HashGroup::DELETED);
+
+            return hash_index;
+        }
+
+        static inline void destroy_nodes(Data data, const Bitset<64>* occupancy, std::uint32_t capacity) {
+            for (std::uint32_t i = next_occupied(occupancy, 0, capacity); i != capacity; i = next_occupied(occupancy, i + 1, capacity)) {
+                data.destroy(i);
+            }
+        }
+
+        inline void release() {
+            if (m_old_data != nullptr) {
+                destroy_nodes(m_old_data, m_old_occupancy, m_old_capacity);
+                deallocate(m_old_data, m_old_control, m_old_occupancy, m_old_capacity);
+                m_old_data = nullptr;
+            }
+            if (m_data != nullptr) {
+                destroy_nodes(m_data, m_occupancy, m_capacity);
+                deallocate(m_data, m_control, m_occupancy, m_capacity);
+                m_data = nullptr;
+            }
+        }
+
+        inline void allocate() {
+            m_data.allocate(m_allocator, m_capacity);
+            m_control = m_control_allocator.allocate(control_size(m_capacity));
+            m_occupancy = m_occupancy_allocator.allocate(occupancy_size(m_capacity));
+            m_growth_limit = growth_limit(m_capacity);
+            m_deleted = 0;
+            m_stats.record_allocation(table_size(m_capacity));
+            clear_control();
+        }
+
+        inline void deallocate(Data data, std::int8_t* control, Bitset<64>* occupancy, std::uint32_t capacity) {
+            data.deallocate(m_allocator, capacity);
+            m_control_allocator.deallocate(control, control_size(capacity));
+            m_occupancy_allocator.deallocate(occupancy, occupancy_size(capacity));
+            m_stats.record_deallocation(table_size(capacity));
+        }
+
+        inline void clear_control() {
+            std::memset(m_control, HashGroup::EMPTY, control_size(m_capacity));
+            for (std::uint32_t i = 0; i < occupancy_size(m_capacity); i++) {
+                std::construct_at(m_occupancy + i);
+            }
         }
 
     private:
-        HashNode<TKey, TValue>* m_data;
-        HashNode<TKey, TValue>* m_head;
+        Data m_data;
+        std::int8_t* m_control;
+        Bitset<64>* m_occupancy;
         std::uint32_t m_count;
         std::uint32_t m_capacity;
+        std::uint32_t m_deleted;
+        std::uint32_t m_growth_limit;
+        float m_max_load_factor;
+        float m_shrink_load_factor;
+        Data m_old_data;
+        std::int8_t* m_old_control;
+        Bitset<64>* m_old_occupancy;
+        std::uint32_t m_old_capacity;
+        std::uint32_t m_migrated;
+        std::uint32_t m_rehash_step;
         TAllocator m_allocator;
+        typename std::allocator_traits<TAllocator>::template rebind_alloc<std::int8_t> m_control_allocator;
+        typename std::allocator_traits<TAllocator>::template rebind_alloc<Bitset<64>> m_occupancy_allocator;
+        [[no_unique_address]] mutable TStats m_stats;
     };
-}
+}
\ No newline at end of file
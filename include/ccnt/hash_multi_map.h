@@ -0,0 +1,202 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "hash_map.h"
+
+namespace ccnt {
+    // A map that keeps every node inserted under a key, built on the HashMap
+    // engine. Nodes sharing a key are reached through equal_range, whose range
+    // refers to the key it was given rather than copying it.
+    template<typename TKey, typename TValue, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t, typename TLayout = InterleavedLayout, typename TStats = NoHashStats>
+    class HashMultiMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Map   = HashMap<TKey, TValue, THashIndex, TAllocator, THash, THashCode, TLayout, TStats>;
+        using Node  = typename Map::Node;
+        using Reference      = typename Map::Reference;
+        using ConstReference = typename Map::ConstReference;
+
+        using Iterator             = typename Map::Iterator;
+        using ConstIterator        = typename Map::ConstIterator;
+        using ReverseIterator      = typename Map::ReverseIterator;
+        using ConstReverseIterator = typename Map::ConstReverseIterator;
+
+    public:
+        HashMultiMap() = default;
+
+        explicit HashMultiMap(std::uint32_t capacity) : m_map(capacity) {
+        }
+
+        HashMultiMap(HashMultiMap&& hash_multi_map) : m_map(std::move(hash_multi_map.m_map)) {
+        }
+
+        ~HashMultiMap() = default;
+
+        template<typename... TArgs>
+        inline Reference emplace(const TKey& key, TArgs&&... args) {
+            return m_map.emplace(key, std::forward<TArgs>(args)...);
+        }
+
+        inline Reference insert(const TKey& key, const TValue& value) {
+            return m_map.insert(key, value);
+        }
+
+        inline auto equal_range(const TKey& key) {
+            return m_map.equal_range(key);
+        }
+
+        inline auto equal_range(const TKey& key) const {
+            return m_map.equal_range(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline auto equal_range(const TLookup& key) {
+            return m_map.equal_range(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline auto equal_range(const TLookup& key) const {
+            return m_map.equal_range(key);
+        }
+
+        // Returns any one of the nodes stored under key.
+        inline Iterator find(const TKey& key) {
+            return m_map.find(key);
+        }
+
+        inline ConstIterator find(const TKey& key) const {
+            return m_map.find(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Iterator find(const TLookup& key) {
+            return m_map.find(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstIterator find(const TLookup& key) const {
+            return m_map.find(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return m_map.contains(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return m_map.contains(key);
+        }
+
+        inline std::uint32_t count(const TKey& key) const {
+            auto range = m_map.equal_range(key);
+            std::uint32_t count = 0;
+            for (auto it = range.begin(); it != range.end(); ++it) {
+                count++;
+            }
+            return count;
+        }
+
+        // Removes every node stored under key and returns how many there were.
+        inline std::uint32_t remove(const TKey& key) {
+            return m_map.remove_all(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline std::uint32_t remove(const TLookup& key) {
+            return m_map.remove_all(key);
+        }
+
+        inline HashMultiMap& operator = (HashMultiMap&& hash_multi_map) {
+            m_map = std::move(hash_multi_map.m_map);
+
+            return *this;
+        }
+
+        inline void clear() {
+            m_map.clear();
+        }
+
+        inline void set_max_load_factor(float max_load_factor) {
+            m_map.set_max_load_factor(max_load_factor);
+        }
+
+        inline void set_rehash_step(std::uint32_t rehash_step) {
+            m_map.set_rehash_step(rehash_step);
+        }
+
+        inline float get_max_load_factor() const {
+            return m_map.get_max_load_factor();
+        }
+
+        inline float get_load_factor() const {
+            return m_map.get_load_factor();
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_map.get_count();
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_map.get_capacity();
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline HashStats get_stats() const {
+            return m_map.get_stats();
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline void reset_stats() {
+            m_map.reset_stats();
+        }
+
+        Iterator begin() {
+            return m_map.begin();
+        }
+
+        Iterator end() {
+            return m_map.end();
+        }
+
+        ConstIterator begin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator end() const {
+            return m_map.cend();
+        }
+
+        ConstIterator cbegin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator cend() const {
+            return m_map.cend();
+        }
+
+        ReverseIterator rbegin() {
+            return m_map.rbegin();
+        }
+
+        ReverseIterator rend() {
+            return m_map.rend();
+        }
+
+        ConstReverseIterator crbegin() const {
+            return m_map.crbegin();
+        }
+
+        ConstReverseIterator crend() const {
+            return m_map.crend();
+        }
+
+        HashMultiMap(const HashMultiMap&) = delete;
+
+    private:
+        Map m_map;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "hash_map.h"
+
+namespace ccnt {
+    // The value type of set nodes. It is empty, and HashNode stores it with
+    // [[no_unique_address]], so a set node is just its key and hash code.
+    class HashSetValue {
+    };
+
+    // A set of unique keys, built on the HashMap engine.
+    template<typename TKey, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, HashSetValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t, typename TLayout = InterleavedLayout, typename TStats = NoHashStats>
+    class HashSet {
+    public:
+        using Key  = TKey;
+        using Map  = HashMap<TKey, HashSetValue, THashIndex, TAllocator, THash, THashCode, TLayout, TStats>;
+        using Node = typename Map::Node;
+
+        using Iterator             = typename Map::Iterator;
+        using ConstIterator        = typename Map::ConstIterator;
+        using ReverseIterator      = typename Map::ReverseIterator;
+        using ConstReverseIterator = typename Map::ConstReverseIterator;
+
+    public:
+        HashSet() = default;
+
+        explicit HashSet(std::uint32_t capacity) : m_map(capacity) {
+        }
+
+        HashSet(HashSet&& hash_set) : m_map(std::move(hash_set.m_map)) {
+        }
+
+        ~HashSet() = default;
+
+        // Inserts key unless it is already present; the bool tells which.
+        inline std::pair<Iterator, bool> insert(const TKey& key) {
+            return m_map.try_emplace(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value && !std::is_same<TLookup, TKey>::value, std::nullptr_t>::type = nullptr>
+        inline std::pair<Iterator, bool> insert(const TLookup& key) {
+            return m_map.try_emplace(key);
+        }
+
+        inline Iterator find(const TKey& key) {
+            return m_map.find(key);
+        }
+
+        inline ConstIterator find(const TKey& key) const {
+            return m_map.find(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Iterator find(const TLookup& key) {
+            return m_map.find(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstIterator find(const TLookup& key) const {
+            return m_map.find(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return m_map.contains(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return m_map.contains(key);
+        }
+
+        inline void remove(const TKey& key) {
+            m_map.remove(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            m_map.remove(key);
+        }
+
+        inline HashSet& operator = (HashSet&& hash_set) {
+            m_map = std::move(hash_set.m_map);
+
+            return *this;
+        }
+
+        inline void clear() {
+            m_map.clear();
+        }
+
+        inline void set_max_load_factor(float max_load_factor) {
+            m_map.set_max_load_factor(max_load_factor);
+        }
+
+        inline void set_rehash_step(std::uint32_t rehash_step) {
+            m_map.set_rehash_step(rehash_step);
+        }
+
+        inline float get_max_load_factor() const {
+            return m_map.get_max_load_factor();
+        }
+
+        inline float get_load_factor() const {
+            return m_map.get_load_factor();
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_map.get_count();
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_map.get_capacity();
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline HashStats get_stats() const {
+            return m_map.get_stats();
+        }
+
+        template<typename TStats1 = TStats, typename std::enable_if<TStats1::ENABLED, std::nullptr_t>::type = nullptr>
+        inline void reset_stats() {
+            m_map.reset_stats();
+        }
+
+        Iterator begin() {
+            return m_map.begin();
+        }
+
+        Iterator end() {
+            return m_map.end();
+        }
+
+        ConstIterator begin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator end() const {
+            return m_map.cend();
+        }
+
+        ConstIterator cbegin() const {
+            return m_map.cbegin();
+        }
+
+        ConstIterator cend() const {
+            return m_map.cend();
+        }
+
+        ReverseIterator rbegin() {
+            return m_map.rbegin();
+        }
+
+        ReverseIterator rend() {
+            return m_map.rend();
+        }
+
+        ConstReverseIterator crbegin() const {
+            return m_map.crbegin();
+        }
+
+        ConstReverseIterator crend() const {
+            return m_map.crend();
+        }
+
+        HashSet(const HashSet&) = delete;
+
+    private:
+        Map m_map;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,373 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include "hash_map.h"
+
+namespace ccnt {
+    // Evicts the least recently used entry. Every hit moves its entry to the
+    // front of the recency list.
+    class LruEviction {
+    public:
+        static constexpr bool SECOND_CHANCE = false;
+    };
+
+    // Evicts with the CLOCK approximation of LRU: a hit only sets the entry's
+    // referenced bit, and eviction sweeps a hand over the slots, clearing the
+    // bits it passes and taking the first entry whose bit is clear.
+    class ClockEviction {
+    public:
+        static constexpr bool SECOND_CHANCE = true;
+    };
+
+    class NoEvictionCallback {
+    public:
+        template<typename TKey, typename TValue>
+        inline void operator () (const TKey&, TValue&) {
+        }
+    };
+
+    // A cache of at most TCapacity entries. The entries live in one array of
+    // slots allocated up front, linked into an intrusive recency list by
+    // index, and a HashMap reserved for TCapacity entries maps keys to slots.
+    // The index doesn't copy keys: its entries point at the slot's node and
+    // reuse the hash code stored there, so a key is hashed once per call.
+    // Hits never allocate; evictions leave tombstones in the index, which it
+    // purges with an occasional rehash. When an insertion finds the cache
+    // full, TOnEvict is called with the key and value of the entry that
+    // makes room, before it is destroyed; it must not touch the cache.
+    template<typename TKey, typename TValue, std::uint32_t TCapacity, typename TEviction = LruEviction, typename TOnEvict = NoEvictionCallback, typename THashIndex = DivisionHashIndex, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class LruCache {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Node  = HashNode<TKey, TValue, THashCode>;
+
+        static_assert(TCapacity != 0, "LruCache requires a capacity");
+
+    private:
+        static constexpr std::uint32_t NIL = ~0u;
+
+        struct Slot {
+            Slot() {
+            }
+
+            ~Slot() {
+            }
+
+            union {
+                Node node;
+            };
+            std::uint32_t previous;
+            std::uint32_t next;
+            bool referenced;
+        };
+
+        // Stands for the key of a slot's node in the index. Two slot keys are
+        // equal only when they are the same node, as keys are unique.
+        class SlotKey {
+        public:
+            explicit SlotKey(const Node* node) : m_node(node) {
+            }
+
+            inline bool operator == (const SlotKey& slot_key) const {
+                return m_node == slot_key.m_node;
+            }
+
+            template<typename TLookup, typename std::enable_if<!std::is_same<TLookup, SlotKey>::value, std::nullptr_t>::type = nullptr>
+            inline bool operator == (const TLookup& key) const {
+                return m_node->get_key() == key;
+            }
+
+        private:
+            const Node* m_node;
+        };
+
+        // The index is only ever searched by key and inserted into with the
+        // node's hash code, so slot keys are never hashed themselves.
+        class SlotHash {
+        public:
+            using is_transparent = void;
+
+            template<typename TLookup>
+            static constexpr auto hash_code(const TLookup& key) {
+                return THash::hash_code(key);
+            }
+        };
+
+        using Index = HashMap<SlotKey, std::uint32_t, THashIndex, std::allocator<HashNode<SlotKey, std::uint32_t, THashCode>>, SlotHash, THashCode>;
+
+    public:
+        explicit LruCache(TOnEvict on_evict = TOnEvict()) : m_slots(new Slot[TCapacity]), m_head(NIL), m_tail(NIL), m_hand(0), m_count(0), m_on_evict(std::move(on_evict)) {
+            m_index.reserve(TCapacity);
+            reset_slots();
+        }
+
+        LruCache(LruCache&& lru_cache) : m_slots(std::move(lru_cache.m_slots)), m_index(std::move(lru_cache.m_index)), m_head(lru_cache.m_head), m_tail(lru_cache.m_tail), m_free(lru_cache.m_free), m_hand(lru_cache.m_hand), m_count(lru_cache.m_count), m_on_evict(std::move(lru_cache.m_on_evict)) {
+            lru_cache.m_count = 0;
+        }
+
+        ~LruCache() {
+            destroy_nodes();
+        }
+
+        // Inserts a key that is not cached yet, evicting an entry if the
+        // cache is full.
+        template<typename... TArgs>
+        inline Node& emplace(const TKey& key, TArgs&&... args) {
+            assert(!m_index.contains(key));
+            return m_slots[insert_node(THash::hash_code(key), key, std::forward<TArgs>(args)...)].node;
+        }
+
+        inline Node& insert(const TKey& key, const TValue& value) {
+            return emplace(key, value);
+        }
+
+        template<typename... TArgs>
+        inline std::pair<Node*, bool> try_emplace(const TKey& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            Node* node = find_node(hash_code, key);
+            if (node != nullptr) {
+                return { node, false };
+            }
+            return { &m_slots[insert_node(hash_code, key, std::forward<TArgs>(args)...)].node, true };
+        }
+
+        template<typename TArg>
+        inline std::pair<Node*, bool> insert_or_assign(const TKey& key, TArg&& value) {
+            THashCode hash_code = THash::hash_code(key);
+            Node* node = find_node(hash_code, key);
+            if (node != nullptr) {
+                node->get_value() = std::forward<TArg>(value);
+                return { node, false };
+            }
+            return { &m_slots[insert_node(hash_code, key, std::forward<TArg>(value))].node, true };
+        }
+
+        // Counts as a use of the entry.
+        inline Node* find(const TKey& key) {
+            return find_node(THash::hash_code(key), key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Node* find(const TLookup& key) {
+            return find_node(THash::hash_code(key), key);
+        }
+
+        // Looks the entry up without counting it as a use.
+        inline const Node* peek(const TKey& key) const {
+            return peek_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node* peek(const TLookup& key) const {
+            return peek_node(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return m_index.contains(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return m_index.contains(key);
+        }
+
+        inline Node& operator [] (const TKey& key) {
+            Node* node = find(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        // Removing an entry doesn't count as an eviction.
+        inline void remove(const TKey& key) {
+            remove_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            remove_node(key);
+        }
+
+        inline LruCache& operator = (LruCache&& lru_cache) {
+            if (this != &lru_cache) {
+                std::destroy_at(this);
+                std::construct_at(this, std::move(lru_cache));
+            }
+
+            return *this;
+        }
+
+        inline void clear() {
+            destroy_nodes();
+            m_index.clear();
+            reset_slots();
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_count;
+        }
+
+        static constexpr std::uint32_t get_capacity() {
+            return TCapacity;
+        }
+
+        LruCache(const LruCache&) = delete;
+        LruCache& operator = (const LruCache&) = delete;
+
+    private:
+        template<typename TLookup>
+        inline Node* find_node(THashCode hash_code, const TLookup& key) {
+            auto it = m_index.find_hashed(hash_code, key);
+            if (it == m_index.end()) {
+                return nullptr;
+            }
+            std::uint32_t slot = (*it).get_value();
+            touch(slot);
+
+            return &m_slots[slot].node;
+        }
+
+        template<typename TLookup>
+        inline const Node* peek_node(const TLookup& key) const {
+            auto it = m_index.find(key);
+            if (it == m_index.cend()) {
+                return nullptr;
+            }
+            return &m_slots[(*it).get_value()].node;
+        }
+
+        template<typename TLookup>
+        inline void remove_node(const TLookup& key) {
+            auto handle = m_index.extract(key);
+            assert(!handle.is_empty());
+
+            std::uint32_t slot = handle.get_value();
+            if constexpr (!TEviction::SECOND_CHANCE) {
+                unlink(slot);
+            }
+            std::destroy_at(&m_slots[slot].node);
+            m_slots[slot].next = m_free;
+            m_free = slot;
+            m_count--;
+        }
+
+        template<typename... TArgs>
+        inline std::uint32_t insert_node(THashCode hash_code, const TKey& key, TArgs&&... args) {
+            std::uint32_t slot = acquire_slot();
+            std::construct_at(&m_slots[slot].node, hash_code, key, std::forward<TArgs>(args)...);
+            m_index.emplace_hashed(hash_code, SlotKey(&m_slots[slot].node), slot);
+            if constexpr (TEviction::SECOND_CHANCE) {
+                m_slots[slot].referenced = false;
+            }
+            else {
+                link_front(slot);
+            }
+            m_count++;
+
+            return slot;
+        }
+
+        inline void touch(std::uint32_t slot) {
+            if constexpr (TEviction::SECOND_CHANCE) {
+                m_slots[slot].referenced = true;
+            }
+            else if (slot != m_head) {
+                unlink(slot);
+                link_front(slot);
+            }
+        }
+
+        // Returns a free slot, evicting an entry when there is none. A full
+        // cache has no free slot, so the clock hand only passes live entries.
+        inline std::uint32_t acquire_slot() {
+            std::uint32_t slot = m_free;
+            if (slot != NIL) {
+                m_free = m_slots[slot].next;
+                return slot;
+            }
+            if constexpr (TEviction::SECOND_CHANCE) {
+                while (m_slots[m_hand].referenced) {
+                    m_slots[m_hand].referenced = false;
+                    m_hand = (m_hand + 1 == TCapacity) ? 0 : m_hand + 1;
+                }
+                slot = m_hand;
+                m_hand = (m_hand + 1 == TCapacity) ? 0 : m_hand + 1;
+            }
+            else {
+                slot = m_tail;
+                unlink(slot);
+            }
+            Node& node = m_slots[slot].node;
+            m_on_evict(node.get_key(), node.get_value());
+            m_index.erase_hashed(node.get_hash_code(), SlotKey(&node));
+            std::destroy_at(&node);
+            m_count--;
+
+            return slot;
+        }
+
+        inline void link_front(std::uint32_t slot) {
+            m_slots[slot].previous = NIL;
+            m_slots[slot].next = m_head;
+            if (m_head != NIL) {
+                m_slots[m_head].previous = slot;
+            }
+            else {
+                m_tail = slot;
+            }
+            m_head = slot;
+        }
+
+        inline void unlink(std::uint32_t slot) {
+            std::uint32_t previous = m_slots[slot].previous;
+            std::uint32_t next = m_slots[slot].next;
+            if (previous != NIL) {
+                m_slots[previous].next = next;
+            }
+            else {
+                m_head = next;
+            }
+            if (next != NIL) {
+                m_slots[next].previous = previous;
+            }
+            else {
+                m_tail = previous;
+            }
+        }
+
+        inline void destroy_nodes() {
+            if (m_count == 0) {
+                return;
+            }
+            for (auto&& node : m_index) {
+                std::destroy_at(&m_slots[node.get_value()].node);
+            }
+        }
+
+        inline void reset_slots() {
+            for (std::uint32_t i = 0; i < TCapacity; i++) {
+                m_slots[i].next = (i + 1 == TCapacity) ? NIL : i + 1;
+            }
+            m_free = 0;
+            m_head = NIL;
+            m_tail = NIL;
+            m_hand = 0;
+            m_count = 0;
+        }
+
+    private:
+        std::unique_ptr<Slot[]> m_slots;
+        Index m_index;
+        std::uint32_t m_head;
+        std::uint32_t m_tail;
+        std::uint32_t m_free;
+        std::uint32_t m_hand;
+        std::uint32_t m_count;
+        [[no_unique_address]] TOnEvict m_on_evict;
+    };
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <bit>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hash_map.h"
+
+namespace ccnt {
+    // On-disk layout: a header, the control bytes, then the node array
+    // aligned to a cache line. Sections are located by their offset from the
+    // start of the file, so the image is valid wherever it is mapped. Hash
+    // codes are unseeded and the image is in host byte order, so a file can be
+    // shared by any process built with the same TKey, TValue, THashIndex and
+    // THash on the same architecture. The header fingerprints both policies,
+    // so an image opened with another one is rejected rather than searched in
+    // the wrong slots.
+    struct MappedHashMapHeader {
+        static constexpr std::uint64_t MAGIC = 0x50414d48544e4343ull;
+        static constexpr std::uint32_t VERSION = 2;
+
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t node_size;
+        std::uint32_t node_alignment;
+        std::uint32_t count;
+        std::uint32_t capacity;
+        std::uint32_t power_of_two;
+        std::uint64_t index_fingerprint;
+        std::uint64_t hash_fingerprint;
+        std::uint64_t control_offset;
+        std::uint64_t data_offset;
+        std::uint64_t size;
+    };
+
+    // A read-only HashMap view over a file written by MappedHashMap::write.
+    // Opening it maps the file and does no per-element work; the pages are
+    // shared with every other process mapping the same file.
+    template<typename TKey, typename TValue, typename THashIndex = DivisionHashIndex, typename THash = HashCode<TKey>>
+    class MappedHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Node  = HashNode<TKey, TValue, void>;
+
+        static_assert(std::is_trivially_copyable<TKey>::value && std::is_trivially_copyable<TValue>::value, "MappedHashMap requires trivially copyable keys and values");
+
+    public:
+        MappedHashMap() : m_image(nullptr), m_size(0), m_control(nullptr), m_data(nullptr), m_count(0), m_capacity(0) {
+        }
+
+        MappedHashMap(MappedHashMap&& mapped_hash_map) : m_image(mapped_hash_map.m_image), m_size(mapped_hash_map.m_size), m_control(mapped_hash_map.m_control), m_data(mapped_hash_map.m_data), m_count(mapped_hash_map.m_count), m_capacity(mapped_hash_map.m_capacity) {
+            mapped_hash_map.m_image = nullptr;
+            mapped_hash_map.m_count = 0;
+            mapped_hash_map.m_capacity = 0;
+        }
+
+        ~MappedHashMap() {
+            close();
+        }
+
+        // Lays out every node of map the way a lookup expects to find it and
+        // writes the image to path.
+        template<typename TMap>
+        static bool write(const char* path, const TMap& map) {
+            std::uint32_t count = map.get_count();
+            std::uint32_t capacity = HashGroup::WIDTH;
+            while (count > growth_limit(capacity)) {
+                capacity *= 2;
+            }
+
+            MappedHashMapHeader header = {};
+            header.magic = MappedHashMapHeader::MAGIC;
+            header.version = MappedHashMapHeader::VERSION;
+            header.node_size = sizeof(Node);
+            header.node_alignment = alignof(Node);
+            header.count = count;
+            header.capacity = capacity;
+            header.power_of_two = THashIndex::POWER_OF_TWO;
+            header.index_fingerprint = index_fingerprint();
+            header.hash_fingerprint = hash_fingerprint();
+            header.control_offset = sizeof(MappedHashMapHeader);
+            header.data_offset = align(header.control_offset + capacity + HashGroup::WIDTH - 1);
+            header.size = header.data_offset + static_cast<std::uint64_t>(capacity) * sizeof(Node);
+
+            std::unique_ptr<std::byte[]> image(new std::byte[header.size]());
+            std::memcpy(image.get(), &header, sizeof(MappedHashMapHeader));
+            std::int8_t* control = reinterpret_cast<std::int8_t*>(image.get() + header.control_offset);
+            Node* data = reinterpret_cast<Node*>(image.get() + header.data_offset);
+            std::memset(control, HashGroup::EMPTY, capacity + HashGroup::WIDTH - 1);
+
+            for (const auto& node : map) {
+                std::uint64_t hash_code = THash::hash_code(node.get_key());
+                std::uint32_t hash_index = THashIndex::hash_index(hash_code, capacity);
+                while (true) {
+                    std::uint32_t empty = HashGroup(control + hash_index).match_empty();
+                    if (empty) {
+                        hash_index = wrap(hash_index + std::countr_zero(empty), capacity);
+                        break;
+                    }
+                    hash_index = wrap(hash_index + HashGroup::WIDTH, capacity);
+                }
+                control[hash_index] = HashGroup::tag(hash_code);
+                if (hash_index < HashGroup::WIDTH - 1) {
+                    control[capacity + hash_index] = HashGroup::tag(hash_code);
+                }
+                std::construct_at(data + hash_index, node.get_key(), node.get_value());
+            }
+
+            std::FILE* file = std::fopen(path, "wb");
+            if (file == nullptr) {
+                return false;
+            }
+            bool written = std::fwrite(image.get(), 1, header.size, file) == header.size;
+            return (std::fclose(file) == 0) && written;
+        }
+
+        // Maps path and validates its header and control bytes. Returns false,
+        // leaving the map closed, if the file can't be mapped, was written for
+        // another layout or policy, or holds no EMPTY slot to end a probe.
+        bool open(const char* path) {
+            close();
+
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat status;
+            if (::fstat(fd, &status) != 0 || static_cast<std::uint64_t>(status.st_size) < sizeof(MappedHashMapHeader)) {
+                ::close(fd);
+                return false;
+            }
+            void* image = ::mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (image == MAP_FAILED) {
+                return false;
+            }
+
+            MappedHashMapHeader header;
+            std::memcpy(&header, image, sizeof(MappedHashMapHeader));
+            bool valid = header.magic == MappedHashMapHeader::MAGIC
+                && header.version == MappedHashMapHeader::VERSION
+                && header.node_size == sizeof(Node)
+                && header.node_alignment == alignof(Node)
+                && header.power_of_two == THashIndex::POWER_OF_TWO
+                && header.index_fingerprint == index_fingerprint()
+                && header.hash_fingerprint == hash_fingerprint()
+                && header.capacity >= HashGroup::WIDTH
+                && std::has_single_bit(header.capacity)
+                && header.count <= growth_limit(header.capacity)
+                && header.data_offset % alignof(Node) == 0
+                && header.control_offset + header.capacity + HashGroup::WIDTH - 1 <= header.data_offset
+                && header.size == header.data_offset + static_cast<std::uint64_t>(header.capacity) * sizeof(Node)
+                && header.size == static_cast<std::uint64_t>(status.st_size)
+                && is_probe_safe(static_cast<const std::int8_t*>(image) + header.control_offset, header.capacity);
+            if (!valid) {
+                ::munmap(image, status.st_size);
+                return false;
+            }
+
+            m_image = image;
+            m_size = status.st_size;
+            m_control = static_cast<const std::int8_t*>(image) + header.control_offset;
+            m_data = reinterpret_cast<const Node*>(static_cast<const std::byte*>(image) + header.data_offset);
+            m_count = header.count;
+            m_capacity = header.capacity;
+
+            return true;
+        }
+
+        void close() {
+            if (m_image != nullptr) {
+                ::munmap(m_image, m_size);
+                m_image = nullptr;
+                m_count = 0;
+                m_capacity = 0;
+            }
+        }
+
+        inline bool is_open() const {
+            return m_image != nullptr;
+        }
+
+        inline const Node* find(const TKey& key) const {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node* find(const TLookup& key) const {
+            return find_node(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return find_node(key) != nullptr;
+        }
+
+        inline const Node& operator [] (const TKey& key) const {
+            const Node* node = find_node(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        template<typename TFunction>
+        inline void for_each(TFunction&& function) const {
+            for (std::uint32_t i = 0; i < m_capacity; i++) {
+                if (m_control[i] >= 0) {
+                    function(m_data[i]);
+                }
+            }
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_count;
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_capacity;
+        }
+
+        MappedHashMap(const MappedHashMap&) = delete;
+        MappedHashMap& operator = (const MappedHashMap&) = delete;
+
+    private:
+        static constexpr std::uint64_t align(std::uint64_t offset) {
+            constexpr std::uint64_t alignment = alignof(Node) > 64 ? alignof(Node) : 64;
+            return (offset + alignment - 1) / alignment * alignment;
+        }
+
+        static constexpr std::uint32_t growth_limit(std::uint32_t capacity) {
+            return capacity / 8 * 7;
+        }
+
+        // Where THashIndex puts a fixed run of hash codes at a fixed capacity.
+        static inline std::uint64_t index_fingerprint() {
+            constexpr std::uint32_t capacity = 1u << 16;
+            std::uint64_t fingerprint = THashIndex::POWER_OF_TWO;
+            for (std::uint64_t i = 0; i < 4; i++) {
+                std::uint64_t hash_code = hash_mix(i ^ HASH_SECRET[0], HASH_SECRET[1]);
+                fingerprint = hash_combine(fingerprint, THashIndex::hash_index(hash_code, capacity));
+            }
+            return fingerprint;
+        }
+
+        // The hash code THash gives the key whose bytes are all zero.
+        static inline std::uint64_t hash_fingerprint() {
+            struct Bytes {
+                std::byte data[sizeof(TKey)];
+            };
+            return THash::hash_code(std::bit_cast<TKey>(Bytes()));
+        }
+
+        // A probe only ends at a group holding an EMPTY slot, and groups near
+        // the end read the mirrored bytes, so both must agree with the table.
+        static inline bool is_probe_safe(const std::int8_t* control, std::uint32_t capacity) {
+            if (std::memcmp(control, control + capacity, HashGroup::WIDTH - 1) != 0) {
+                return false;
+            }
+            for (std::uint32_t i = 0; i < capacity; i += HashGroup::WIDTH) {
+                if (HashGroup(control + i).match_empty()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static inline std::uint32_t wrap(std::uint32_t index, std::uint32_t capacity) {
+            if constexpr (THashIndex::POWER_OF_TWO) {
+                return index & (capacity - 1);
+            }
+            return (index >= capacity) ? index - capacity : index;
+        }
+
+        template<typename TLookup>
+        inline const Node* find_node(const TLookup& key) const {
+            if (m_image == nullptr) {
+                return nullptr;
+            }
+            std::uint64_t hash_code = THash::hash_code(key);
+            std::int8_t tag = HashGroup::tag(hash_code);
+            std::uint32_t hash_index = THashIndex::hash_index(hash_code, m_capacity);
+
+            while (true) {
+                HashGroup group(m_control + hash_index);
+                for (std::uint32_t match = group.match(tag); match; match &= match - 1) {
+                    std::uint32_t index = wrap(hash_index + std::countr_zero(match), m_capacity);
+                    if (m_data[index].get_key() == key) {
+                        return m_data + index;
+                    }
+                }
+                if (group.match_empty()) {
+                    return nullptr;
+                }
+                hash_index = wrap(hash_index + HashGroup::WIDTH, m_capacity);
+            }
+        }
+
+    private:
+        void* m_image;
+        std::size_t m_size;
+        const std::int8_t* m_control;
+        const Node* m_data;
+        std::uint32_t m_count;
+        std::uint32_t m_capacity;
+    };
+}
\ No newline at end of file
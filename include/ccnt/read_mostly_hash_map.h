@@ -0,0 +1,255 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include "hash_map.h"
+#include "vector.h"
+
+namespace ccnt {
+    // A map for tables that are read far more often than they change. Readers
+    // never lock: they look keys up in an immutable HashMap published through
+    // an atomic pointer. Writers serialize on a mutex, copy the current
+    // version, modify the copy and publish it. Replaced versions are retired
+    // and freed once no reader can still be inside them.
+    //
+    // Reclamation is epoch based. Each reader owns one of TReaders slots, on
+    // its own cache line, and records the global epoch in it for the duration
+    // of a lookup. A version retired at epoch e is freed once every slot is
+    // either idle or past e.
+    template<typename TKey, typename TValue, std::uint32_t TReaders = 64, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class ReadMostlyHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Map   = HashMap<TKey, TValue, THashIndex, TAllocator, THash, THashCode>;
+        using Node  = typename Map::Node;
+
+        // A registered reader. Each thread reading the map holds its own
+        // Reader; a Reader must not be used by two threads at once.
+        class Reader {
+        public:
+            Reader(Reader&& reader) : m_map(reader.m_map), m_slot(reader.m_slot) {
+                reader.m_map = nullptr;
+            }
+
+            ~Reader() {
+                if (m_map != nullptr) {
+                    m_map->m_slots[m_slot].registered.store(false, std::memory_order_release);
+                }
+            }
+
+            inline bool find(const TKey& key, TValue& value) const {
+                return visit(key, [&](const Node& node) {
+                    value = node.get_value();
+                });
+            }
+
+            inline bool contains(const TKey& key) const {
+                return visit(key, [](const Node&) {});
+            }
+
+            // Calls function with the node while the version holding it is
+            // pinned. The node must not be kept past the call.
+            template<typename TFunction>
+            inline bool visit(const TKey& key, TFunction&& function) const {
+                const Map* map = pin();
+                auto it = map->find(key);
+                bool found = it != map->cend();
+                if (found) {
+                    function(*it);
+                }
+                unpin();
+
+                return found;
+            }
+
+            template<typename TFunction>
+            inline void for_each(TFunction&& function) const {
+                const Map* map = pin();
+                for (const Node& node : *map) {
+                    function(node);
+                }
+                unpin();
+            }
+
+            inline std::uint32_t get_count() const {
+                const Map* map = pin();
+                std::uint32_t count = map->get_count();
+                unpin();
+
+                return count;
+            }
+
+            Reader(const Reader&) = delete;
+            Reader& operator = (const Reader&) = delete;
+
+        private:
+            Reader(const ReadMostlyHashMap* map, std::uint32_t slot) : m_map(map), m_slot(slot) {
+            }
+
+            inline const Map* pin() const {
+                m_map->m_slots[m_slot].epoch.store(m_map->m_epoch.load(std::memory_order_acquire), std::memory_order_seq_cst);
+                return m_map->m_current.load(std::memory_order_seq_cst);
+            }
+
+            inline void unpin() const {
+                m_map->m_slots[m_slot].epoch.store(IDLE, std::memory_order_release);
+            }
+
+        private:
+            const ReadMostlyHashMap* m_map;
+            std::uint32_t m_slot;
+
+            friend class ReadMostlyHashMap;
+        };
+
+    public:
+        ReadMostlyHashMap() : m_current(new Map()), m_epoch(1) {
+        }
+
+        explicit ReadMostlyHashMap(std::uint32_t capacity) : m_current(new Map(capacity)), m_epoch(1) {
+        }
+
+        ~ReadMostlyHashMap() {
+            for (std::uint32_t i = 0; i < TReaders; i++) {
+                assert(!m_slots[i].registered.load(std::memory_order_relaxed));
+            }
+            for (std::uint32_t i = 0; i < m_retired.get_count(); i++) {
+                delete m_retired[i].map;
+            }
+            delete m_current.load(std::memory_order_relaxed);
+        }
+
+        // Registers a reader. When all TReaders slots are taken it waits for
+        // another reader to be destroyed, so the returned Reader is always
+        // usable.
+        inline Reader get_reader() const {
+            while (true) {
+                for (std::uint32_t i = 0; i < TReaders; i++) {
+                    bool registered = false;
+                    if (m_slots[i].registered.compare_exchange_strong(registered, true, std::memory_order_acquire)) {
+                        return Reader(this, i);
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        // Applies function to a copy of the current version and publishes the
+        // result, so several changes cost a single copy. The copy keeps the
+        // current capacity and layout, so no key is rehashed.
+        template<typename TFunction>
+        inline void update(TFunction&& function) {
+            std::lock_guard lock(m_writer);
+
+            const Map* current = m_current.load(std::memory_order_relaxed);
+            Map* map = new Map(current->clone());
+            function(*map);
+
+            publish(map);
+        }
+
+        template<typename... TArgs>
+        inline bool emplace(const TKey& key, TArgs&&... args) {
+            bool inserted = false;
+            update([&](Map& map) {
+                inserted = map.try_emplace(key, std::forward<TArgs>(args)...).second;
+            });
+            return inserted;
+        }
+
+        template<typename TArg>
+        inline bool insert_or_assign(const TKey& key, TArg&& value) {
+            bool inserted = false;
+            update([&](Map& map) {
+                inserted = map.insert_or_assign(key, std::forward<TArg>(value)).second;
+            });
+            return inserted;
+        }
+
+        inline bool remove(const TKey& key) {
+            bool removed = false;
+            update([&](Map& map) {
+                removed = map.contains(key);
+                if (removed) {
+                    map.remove(key);
+                }
+            });
+            return removed;
+        }
+
+        inline void clear() {
+            std::lock_guard lock(m_writer);
+            publish(new Map());
+        }
+
+        // Frees the retired versions no reader can still see. Writers call it
+        // after every publish; it never blocks on readers.
+        inline void reclaim() {
+            std::lock_guard lock(m_writer);
+            reclaim_retired();
+        }
+
+        inline std::uint32_t get_retired_count() const {
+            std::lock_guard lock(m_writer);
+            return m_retired.get_count();
+        }
+
+        ReadMostlyHashMap(const ReadMostlyHashMap&) = delete;
+        ReadMostlyHashMap& operator = (const ReadMostlyHashMap&) = delete;
+
+    private:
+        static constexpr std::uint64_t IDLE = 0;
+
+        struct alignas(64) ReaderSlot {
+            std::atomic<std::uint64_t> epoch = IDLE;
+            std::atomic<bool> registered = false;
+        };
+
+        struct Retired {
+            const Map* map;
+            std::uint64_t epoch;
+        };
+
+        // A reader that pinned an epoch after the bump below also loads the
+        // pointer after the exchange, so only readers at or before the retire
+        // epoch can hold the old version.
+        inline void publish(Map* map) {
+            const Map* old = m_current.exchange(map, std::memory_order_seq_cst);
+            m_retired.push_back({ old, m_epoch.fetch_add(1, std::memory_order_seq_cst) });
+            reclaim_retired();
+        }
+
+        inline void reclaim_retired() {
+            std::uint64_t oldest = ~static_cast<std::uint64_t>(0);
+            for (std::uint32_t i = 0; i < TReaders; i++) {
+                std::uint64_t epoch = m_slots[i].epoch.load(std::memory_order_seq_cst);
+                if (epoch != IDLE && epoch < oldest) {
+                    oldest = epoch;
+                }
+            }
+            for (std::uint32_t i = 0; i < m_retired.get_count();) {
+                if (m_retired[i].epoch < oldest) {
+                    delete m_retired[i].map;
+                    m_retired.swap_and_pop_at(i);
+                }
+                else {
+                    i++;
+                }
+            }
+        }
+
+    private:
+        std::atomic<Map*> m_current;
+        std::atomic<std::uint64_t> m_epoch;
+        mutable ReaderSlot m_slots[TReaders];
+        mutable std::mutex m_writer;
+        Vector<Retired> m_retired;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,389 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include "hash_map.h"
+
+namespace ccnt {
+    // A map that keeps up to TCapacity nodes inline and finds them with a
+    // linear scan, allocating nothing. Inserting past TCapacity moves the
+    // nodes into a HashMap, which the map keeps using from then on, clear()
+    // included.
+    template<typename TKey, typename TValue, std::uint32_t TCapacity = 8, typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<HashNode<TKey, TValue>>, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class SmallHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Map   = HashMap<TKey, TValue, THashIndex, TAllocator, THash, THashCode>;
+        using Node  = typename Map::Node;
+
+        static_assert(TCapacity != 0, "SmallHashMap requires an inline capacity");
+
+        class Iterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = Node;
+            using Pointer   = Node*;
+            using Reference = Node&;
+
+        public:
+            Iterator(Pointer node) : m_node(node), m_it(nullptr, nullptr, 0, 0) {
+            }
+
+            Iterator(typename Map::Iterator it) : m_node(nullptr), m_it(it) {
+            }
+            ~Iterator() = default;
+
+            Reference operator * () {
+                return (m_node != nullptr) ? *m_node : *m_it;
+            }
+
+            Pointer operator -> () {
+                return (m_node != nullptr) ? m_node : m_it.operator->();
+            }
+
+            void operator ++ () {
+                if (m_node != nullptr) {
+                    ++m_node;
+                }
+                else {
+                    ++m_it;
+                }
+            }
+
+            bool operator == (const Iterator& it) {
+                return m_node == it.m_node && m_it == it.m_it;
+            }
+
+            bool operator != (const Iterator& it) {
+                return m_node != it.m_node || m_it != it.m_it;
+            }
+
+        protected:
+            Pointer m_node;
+            typename Map::Iterator m_it;
+        };
+
+        class ConstIterator {
+        public:
+            using Type = SparseIterator;
+            using ValueType = const Node;
+            using Pointer   = const Node*;
+            using Reference = const Node&;
+
+        public:
+            ConstIterator(Pointer node) : m_node(node), m_it(nullptr, nullptr, 0, 0) {
+            }
+
+            ConstIterator(typename Map::ConstIterator it) : m_node(nullptr), m_it(it) {
+            }
+            ~ConstIterator() = default;
+
+            Reference operator * () const {
+                return (m_node != nullptr) ? *m_node : *m_it;
+            }
+
+            Pointer operator -> () const {
+                return (m_node != nullptr) ? m_node : m_it.operator->();
+            }
+
+            void operator ++ () {
+                if (m_node != nullptr) {
+                    ++m_node;
+                }
+                else {
+                    ++m_it;
+                }
+            }
+
+            bool operator == (const ConstIterator& it) const {
+                return m_node == it.m_node && m_it == it.m_it;
+            }
+
+            bool operator != (const ConstIterator& it) const {
+                return m_node != it.m_node || m_it != it.m_it;
+            }
+
+        protected:
+            Pointer m_node;
+            typename Map::ConstIterator m_it;
+        };
+
+    public:
+        SmallHashMap() : m_count(0), m_inline(true) {
+        }
+
+        SmallHashMap(SmallHashMap&& small_hash_map) : m_count(small_hash_map.m_count), m_inline(small_hash_map.m_inline) {
+            if (m_inline) {
+                for (std::uint32_t i = 0; i < m_count; i++) {
+                    std::construct_at(m_nodes + i, std::move(small_hash_map.m_nodes[i]));
+                }
+            }
+            else {
+                std::construct_at(&m_map, std::move(small_hash_map.m_map));
+            }
+        }
+
+        ~SmallHashMap() {
+            release();
+        }
+
+        template<typename... TArgs>
+        inline Node& emplace(const TKey& key, TArgs&&... args) {
+            if (!m_inline) {
+                return m_map.emplace(key, std::forward<TArgs>(args)...);
+            }
+            return *emplace_inline(THash::hash_code(key), key, std::forward<TArgs>(args)...);
+        }
+
+        inline Node& insert(const TKey& key, const TValue& value) {
+            return emplace(key, value);
+        }
+
+        template<typename... TArgs>
+        inline std::pair<Iterator, bool> try_emplace(const TKey& key, TArgs&&... args) {
+            if (!m_inline) {
+                return m_map.try_emplace(key, std::forward<TArgs>(args)...);
+            }
+            THashCode hash_code = THash::hash_code(key);
+            std::uint32_t index = find_index(key, hash_code);
+            if (index != m_count) {
+                return { Iterator(m_nodes + index), false };
+            }
+            return { emplace_inline(hash_code, key, std::forward<TArgs>(args)...), true };
+        }
+
+        template<typename TArg>
+        inline std::pair<Iterator, bool> insert_or_assign(const TKey& key, TArg&& value) {
+            if (!m_inline) {
+                return m_map.insert_or_assign(key, std::forward<TArg>(value));
+            }
+            THashCode hash_code = THash::hash_code(key);
+            std::uint32_t index = find_index(key, hash_code);
+            if (index != m_count) {
+                m_nodes[index].get_value() = std::forward<TArg>(value);
+                return { Iterator(m_nodes + index), false };
+            }
+            return { emplace_inline(hash_code, key, std::forward<TArg>(value)), true };
+        }
+
+        inline Iterator find(const TKey& key) {
+            return find_node(key);
+        }
+
+        inline ConstIterator find(const TKey& key) const {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Iterator find(const TLookup& key) {
+            return find_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline ConstIterator find(const TLookup& key) const {
+            return find_node(key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return contains_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return contains_node(key);
+        }
+
+        inline Node& operator [] (const TKey& key) {
+            return get_node(key);
+        }
+
+        inline const Node& operator [] (const TKey& key) const {
+            return get_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Node& operator [] (const TLookup& key) {
+            return get_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node& operator [] (const TLookup& key) const {
+            return get_node(key);
+        }
+
+        inline void remove(const TKey& key) {
+            remove_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            remove_node(key);
+        }
+
+        inline SmallHashMap& operator = (SmallHashMap&& small_hash_map) {
+            if (this != &small_hash_map) {
+                release();
+                std::construct_at(this, std::move(small_hash_map));
+            }
+
+            return *this;
+        }
+
+        inline void clear() {
+            if (!m_inline) {
+                return m_map.clear();
+            }
+            std::destroy(m_nodes, m_nodes + m_count);
+            m_count = 0;
+        }
+
+        inline bool is_inline() const {
+            return m_inline;
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_inline ? m_count : m_map.get_count();
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_inline ? TCapacity : m_map.get_capacity();
+        }
+
+        Iterator begin() {
+            return m_inline ? Iterator(m_nodes) : Iterator(m_map.begin());
+        }
+
+        Iterator end() {
+            return m_inline ? Iterator(m_nodes + m_count) : Iterator(m_map.end());
+        }
+
+        ConstIterator begin() const {
+            return cbegin();
+        }
+
+        ConstIterator end() const {
+            return cend();
+        }
+
+        ConstIterator cbegin() const {
+            return m_inline ? ConstIterator(m_nodes) : ConstIterator(m_map.cbegin());
+        }
+
+        ConstIterator cend() const {
+            return m_inline ? ConstIterator(m_nodes + m_count) : ConstIterator(m_map.cend());
+        }
+
+        SmallHashMap(const SmallHashMap&) = delete;
+        SmallHashMap& operator = (const SmallHashMap&) = delete;
+
+    private:
+        template<typename TLookup>
+        inline std::uint32_t find_index(const TLookup& key, THashCode hash_code) const {
+            for (std::uint32_t i = 0; i < m_count; i++) {
+                if (m_nodes[i].get_hash_code() == hash_code && m_nodes[i].get_key() == key) {
+                    return i;
+                }
+            }
+            return m_count;
+        }
+
+        template<typename TLookup>
+        inline Iterator find_node(const TLookup& key) {
+            if (!m_inline) {
+                return m_map.find(key);
+            }
+            return Iterator(m_nodes + find_index(key, THash::hash_code(key)));
+        }
+
+        template<typename TLookup>
+        inline ConstIterator find_node(const TLookup& key) const {
+            if (!m_inline) {
+                return m_map.find(key);
+            }
+            return ConstIterator(m_nodes + find_index(key, THash::hash_code(key)));
+        }
+
+        template<typename TLookup>
+        inline Node& get_node(const TLookup& key) {
+            Iterator it = find_node(key);
+            assert(it != end());
+
+            return *it;
+        }
+
+        template<typename TLookup>
+        inline const Node& get_node(const TLookup& key) const {
+            ConstIterator it = find_node(key);
+            assert(it != cend());
+
+            return *it;
+        }
+
+        template<typename TLookup>
+        inline bool contains_node(const TLookup& key) const {
+            if (!m_inline) {
+                return m_map.contains(key);
+            }
+            return find_index(key, THash::hash_code(key)) != m_count;
+        }
+
+        // The last node fills the hole, so the inline nodes stay contiguous.
+        template<typename TLookup>
+        inline void remove_node(const TLookup& key) {
+            if (!m_inline) {
+                return m_map.remove(key);
+            }
+            std::uint32_t index = find_index(key, THash::hash_code(key));
+            assert(index != m_count);
+
+            std::destroy_at(m_nodes + index);
+            if (index != --m_count) {
+                std::construct_at(m_nodes + index, std::move(m_nodes[m_count]));
+                std::destroy_at(m_nodes + m_count);
+            }
+        }
+
+        template<typename... TArgs>
+        inline Iterator emplace_inline(THashCode hash_code, const TKey& key, TArgs&&... args) {
+            if (m_count == TCapacity) {
+                spill();
+                return m_map.emplace_hashed(hash_code, key, std::forward<TArgs>(args)...);
+            }
+            std::construct_at(m_nodes + m_count, hash_code, key, std::forward<TArgs>(args)...);
+
+            return Iterator(m_nodes + m_count++);
+        }
+
+        // Every inline node keeps its hash code, so none is hashed again.
+        inline void spill() {
+            Map map(TCapacity * 2);
+            for (std::uint32_t i = 0; i < m_count; i++) {
+                map.emplace_hashed(m_nodes[i].get_hash_code(), m_nodes[i].get_key(), std::move(m_nodes[i].get_value()));
+            }
+            std::destroy(m_nodes, m_nodes + m_count);
+            std::construct_at(&m_map, std::move(map));
+            m_inline = false;
+        }
+
+        inline void release() {
+            if (m_inline) {
+                std::destroy(m_nodes, m_nodes + m_count);
+            }
+            else {
+                std::destroy_at(&m_map);
+            }
+        }
+
+    private:
+        union {
+            Node m_nodes[TCapacity];
+            Map m_map;
+        };
+        std::uint32_t m_count;
+        bool m_inline;
+    };
+}
\ No newline at end of file
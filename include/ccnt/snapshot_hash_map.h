@@ -0,0 +1,505 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+#include "hash_map.h"
+
+namespace ccnt {
+    // A hash map whose point-in-time snapshots cost O(1) to take. Slots live
+    // in reference counted chunks of TChunkSlots, each holding its control
+    // bytes and nodes, and probing walks whole groups aligned to WIDTH so a
+    // group never spans two chunks. A snapshot shares the table; the first
+    // write after one copies the chunk directory, and every write copies the
+    // chunk it touches if a snapshot still holds it. Unmodified chunks stay
+    // shared.
+    //
+    // The map itself is single threaded, snapshot included. A Snapshot is
+    // read-only and may be read, and destroyed, on any thread while the map
+    // keeps being written. Nodes are copied when a shared chunk is
+    // written, so TKey and TValue must be copy constructible.
+    template<typename TKey, typename TValue, std::uint32_t TChunkSlots = 256, typename THashIndex = DivisionHashIndex, typename THash = HashCode<TKey>, typename THashCode = std::uint32_t>
+    class SnapshotHashMap {
+    public:
+        using Value = TValue;
+        using Key   = TKey;
+        using Node  = HashNode<TKey, TValue, THashCode>;
+
+        static_assert(TChunkSlots % HashGroup::WIDTH == 0, "SnapshotHashMap chunks must hold whole groups");
+        static_assert(!THashIndex::POWER_OF_TWO || std::has_single_bit(TChunkSlots), "THashIndex requires a power of two capacity");
+
+    private:
+        struct Chunk {
+            Chunk() : references(1) {
+                std::memset(control, HashGroup::EMPTY, TChunkSlots);
+            }
+
+            ~Chunk() {
+            }
+
+            std::atomic<std::uint32_t> references;
+            std::int8_t control[TChunkSlots];
+            union {
+                Node nodes[TChunkSlots];
+            };
+        };
+
+        struct Table {
+            explicit Table(std::uint32_t capacity) : references(1), count(0), deleted(0), capacity(capacity), chunks(new Chunk*[capacity / TChunkSlots]) {
+            }
+
+            std::atomic<std::uint32_t> references;
+            std::uint32_t count;
+            std::uint32_t deleted;
+            std::uint32_t capacity;
+            std::unique_ptr<Chunk*[]> chunks;
+        };
+
+    public:
+        class Snapshot {
+        public:
+            Snapshot() : m_table(nullptr) {
+            }
+
+            Snapshot(Snapshot&& snapshot) : m_table(snapshot.m_table) {
+                snapshot.m_table = nullptr;
+            }
+
+            ~Snapshot() {
+                release_table(m_table);
+            }
+
+            inline Snapshot& operator = (Snapshot&& snapshot) {
+                if (this != &snapshot) {
+                    release_table(m_table);
+                    m_table = snapshot.m_table;
+                    snapshot.m_table = nullptr;
+                }
+
+                return *this;
+            }
+
+            inline const Node* find(const TKey& key) const {
+                return find_node(m_table, key);
+            }
+
+            template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+            inline const Node* find(const TLookup& key) const {
+                return find_node(m_table, key);
+            }
+
+            inline bool contains(const TKey& key) const {
+                return find_node(m_table, key) != nullptr;
+            }
+
+            template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+            inline bool contains(const TLookup& key) const {
+                return find_node(m_table, key) != nullptr;
+            }
+
+            template<typename TFunction>
+            inline void for_each(TFunction&& function) const {
+                for_each_node(m_table, function);
+            }
+
+            inline std::uint32_t get_count() const {
+                return (m_table != nullptr) ? m_table->count : 0;
+            }
+
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator = (const Snapshot&) = delete;
+
+        private:
+            explicit Snapshot(Table* table) : m_table(table) {
+            }
+
+        private:
+            Table* m_table;
+
+            friend class SnapshotHashMap;
+        };
+
+    public:
+        SnapshotHashMap() : m_table(new_table(TChunkSlots)) {
+        }
+
+        explicit SnapshotHashMap(std::uint32_t capacity) : m_table(new_table(round_capacity(capacity))) {
+        }
+
+        SnapshotHashMap(SnapshotHashMap&& snapshot_hash_map) : m_table(snapshot_hash_map.m_table) {
+            snapshot_hash_map.m_table = nullptr;
+        }
+
+        ~SnapshotHashMap() {
+            release_table(m_table);
+        }
+
+        // O(1): the snapshot shares every chunk with the map.
+        inline Snapshot snapshot() const {
+            m_table->references.fetch_add(1, std::memory_order_relaxed);
+            return Snapshot(m_table);
+        }
+
+        template<typename... TArgs>
+        inline Node& emplace(const TKey& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            return insert_node(hash_code, key, std::forward<TArgs>(args)...);
+        }
+
+        inline Node& insert(const TKey& key, const TValue& value) {
+            return emplace(key, value);
+        }
+
+        template<typename... TArgs>
+        inline std::pair<Node*, bool> try_emplace(const TKey& key, TArgs&&... args) {
+            THashCode hash_code = THash::hash_code(key);
+            Node* node = find_writable(key, hash_code);
+            if (node != nullptr) {
+                return { node, false };
+            }
+            return { &insert_node(hash_code, key, std::forward<TArgs>(args)...), true };
+        }
+
+        template<typename TArg>
+        inline std::pair<Node*, bool> insert_or_assign(const TKey& key, TArg&& value) {
+            THashCode hash_code = THash::hash_code(key);
+            Node* node = find_writable(key, hash_code);
+            if (node != nullptr) {
+                node->get_value() = std::forward<TArg>(value);
+                return { node, false };
+            }
+            return { &insert_node(hash_code, key, std::forward<TArg>(value)), true };
+        }
+
+        // The mutable overloads copy the chunk holding the node if a snapshot
+        // shares it.
+        inline Node* find(const TKey& key) {
+            return find_writable(key, THash::hash_code(key));
+        }
+
+        inline const Node* find(const TKey& key) const {
+            return find_node(m_table, key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline Node* find(const TLookup& key) {
+            return find_writable(key, THash::hash_code(key));
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline const Node* find(const TLookup& key) const {
+            return find_node(m_table, key);
+        }
+
+        inline bool contains(const TKey& key) const {
+            return find_node(m_table, key) != nullptr;
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline bool contains(const TLookup& key) const {
+            return find_node(m_table, key) != nullptr;
+        }
+
+        inline Node& operator [] (const TKey& key) {
+            Node* node = find(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        inline const Node& operator [] (const TKey& key) const {
+            const Node* node = find(key);
+            assert(node != nullptr);
+
+            return *node;
+        }
+
+        inline void remove(const TKey& key) {
+            remove_node(key);
+        }
+
+        template<typename TLookup, typename THash1 = THash, typename std::enable_if<IsTransparentHash<THash1>::value, std::nullptr_t>::type = nullptr>
+        inline void remove(const TLookup& key) {
+            remove_node(key);
+        }
+
+        template<typename TFunction>
+        inline void for_each(TFunction&& function) const {
+            for_each_node(m_table, function);
+        }
+
+        inline SnapshotHashMap& operator = (SnapshotHashMap&& snapshot_hash_map) {
+            if (this != &snapshot_hash_map) {
+                release_table(m_table);
+                m_table = snapshot_hash_map.m_table;
+                snapshot_hash_map.m_table = nullptr;
+            }
+
+            return *this;
+        }
+
+        // Snapshots keep the contents they were taken with.
+        inline void clear() {
+            std::uint32_t capacity = m_table->capacity;
+            release_table(m_table);
+            m_table = new_table(capacity);
+        }
+
+        inline float get_load_factor() const {
+            return static_cast<float>(m_table->count) / m_table->capacity;
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_table->count;
+        }
+
+        inline std::uint32_t get_capacity() const {
+            return m_table->capacity;
+        }
+
+        SnapshotHashMap(const SnapshotHashMap&) = delete;
+        SnapshotHashMap& operator = (const SnapshotHashMap&) = delete;
+
+    private:
+        static constexpr std::uint32_t round_capacity(std::uint32_t capacity) {
+            std::uint32_t rounded = TChunkSlots;
+            while (rounded / 8 * 7 < capacity) {
+                rounded *= 2;
+            }
+            return rounded;
+        }
+
+        static inline Table* new_table(std::uint32_t capacity) {
+            Table* table = new Table(capacity);
+            for (std::uint32_t i = 0; i < capacity / TChunkSlots; i++) {
+                table->chunks[i] = new Chunk();
+            }
+            return table;
+        }
+
+        static inline void release_chunk(Chunk* chunk) {
+            if (chunk->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                for (std::uint32_t i = 0; i < TChunkSlots; i++) {
+                    if (chunk->control[i] >= 0) {
+                        std::destroy_at(chunk->nodes + i);
+                    }
+                }
+                delete chunk;
+            }
+        }
+
+        static inline void release_table(Table* table) {
+            if (table != nullptr && table->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                for (std::uint32_t i = 0; i < table->capacity / TChunkSlots; i++) {
+                    release_chunk(table->chunks[i]);
+                }
+                delete table;
+            }
+        }
+
+        // The group holding the home slot THashIndex picks out of all the
+        // table's slots. Indexing over the group count instead would hand a
+        // one group table to power of two policies.
+        static inline std::uint32_t home_group(THashCode hash_code, std::uint32_t capacity) {
+            return THashIndex::hash_index(hash_code, capacity) / HashGroup::WIDTH;
+        }
+
+        static inline std::uint32_t next_group(std::uint32_t group, std::uint32_t groups) {
+            return (group + 1 == groups) ? 0 : group + 1;
+        }
+
+        // Returns the slot holding key, as chunk * TChunkSlots + offset, or
+        // the table's capacity when it is missing. The home group is picked
+        // from the low bits of the hash code, or a product of the whole code,
+        // and the tag from the top bits, so keys sharing a group still differ
+        // by tag.
+        template<typename TLookup>
+        static inline std::uint32_t locate(const Table* table, const TLookup& key, THashCode hash_code) {
+            std::int8_t tag = HashGroup::tag(hash_code);
+            std::uint32_t groups = table->capacity / HashGroup::WIDTH;
+            std::uint32_t group = home_group(hash_code, table->capacity);
+
+            while (true) {
+                std::uint32_t first = group * HashGroup::WIDTH;
+                const Chunk* chunk = table->chunks[first / TChunkSlots];
+                std::uint32_t offset = first % TChunkSlots;
+
+                HashGroup hash_group(chunk->control + offset);
+                for (std::uint32_t match = hash_group.match(tag); match; match &= match - 1) {
+                    std::uint32_t index = offset + std::countr_zero(match);
+                    if (chunk->nodes[index].get_hash_code() == hash_code && chunk->nodes[index].get_key() == key) {
+                        return first + std::countr_zero(match);
+                    }
+                }
+                if (hash_group.match_empty()) {
+                    return table->capacity;
+                }
+                group = next_group(group, groups);
+            }
+        }
+
+        template<typename TLookup>
+        static inline const Node* find_node(const Table* table, const TLookup& key) {
+            if (table == nullptr) {
+                return nullptr;
+            }
+            std::uint32_t index = locate(table, key, THash::hash_code(key));
+            if (index == table->capacity) {
+                return nullptr;
+            }
+            return table->chunks[index / TChunkSlots]->nodes + index % TChunkSlots;
+        }
+
+        template<typename TFunction>
+        static inline void for_each_node(const Table* table, TFunction& function) {
+            if (table == nullptr) {
+                return;
+            }
+            for (std::uint32_t i = 0; i < table->capacity / TChunkSlots; i++) {
+                const Chunk* chunk = table->chunks[i];
+                for (std::uint32_t j = 0; j < TChunkSlots; j++) {
+                    if (chunk->control[j] >= 0) {
+                        function(chunk->nodes[j]);
+                    }
+                }
+            }
+        }
+
+        static inline std::uint32_t find_empty_index(const Table* table, THashCode hash_code) {
+            std::uint32_t groups = table->capacity / HashGroup::WIDTH;
+            std::uint32_t group = home_group(hash_code, table->capacity);
+
+            while (true) {
+                std::uint32_t first = group * HashGroup::WIDTH;
+                std::uint32_t empty = HashGroup(table->chunks[first / TChunkSlots]->control + first % TChunkSlots).match_empty_or_deleted();
+                if (empty) {
+                    return first + std::countr_zero(empty);
+                }
+                group = next_group(group, groups);
+            }
+        }
+
+        // Gives the map a directory no snapshot shares. The chunks stay shared.
+        inline void own_table() {
+            if (m_table->references.load(std::memory_order_acquire) == 1) {
+                return;
+            }
+            Table* table = new Table(m_table->capacity);
+            table->count = m_table->count;
+            table->deleted = m_table->deleted;
+            for (std::uint32_t i = 0; i < m_table->capacity / TChunkSlots; i++) {
+                table->chunks[i] = m_table->chunks[i];
+                table->chunks[i]->references.fetch_add(1, std::memory_order_relaxed);
+            }
+            release_table(m_table);
+            m_table = table;
+        }
+
+        // Returns chunk i of the map's own directory, copied first if a
+        // snapshot still holds it.
+        inline Chunk* own_chunk(std::uint32_t i) {
+            Chunk* chunk = m_table->chunks[i];
+            if (chunk->references.load(std::memory_order_acquire) == 1) {
+                return chunk;
+            }
+            Chunk* copy = new Chunk();
+            std::memcpy(copy->control, chunk->control, TChunkSlots);
+            for (std::uint32_t j = 0; j < TChunkSlots; j++) {
+                if (chunk->control[j] >= 0) {
+                    const Node& node = chunk->nodes[j];
+                    std::construct_at(copy->nodes + j, node.get_hash_code(), node.get_key(), node.get_value());
+                }
+            }
+            release_chunk(chunk);
+            m_table->chunks[i] = copy;
+
+            return copy;
+        }
+
+        template<typename TLookup>
+        inline Node* find_writable(const TLookup& key, THashCode hash_code) {
+            std::uint32_t index = locate(m_table, key, hash_code);
+            if (index == m_table->capacity) {
+                return nullptr;
+            }
+            own_table();
+            return own_chunk(index / TChunkSlots)->nodes + index % TChunkSlots;
+        }
+
+        template<typename... TArgs>
+        inline Node& insert_node(THashCode hash_code, const TKey& key, TArgs&&... args) {
+            own_table();
+            if (m_table->count + m_table->deleted >= m_table->capacity / 8 * 7) {
+                rehash((m_table->count < m_table->capacity / 16 * 7) ? m_table->capacity : m_table->capacity * 2);
+            }
+            std::uint32_t index = find_empty_index(m_table, hash_code);
+            Chunk* chunk = own_chunk(index / TChunkSlots);
+            std::uint32_t offset = index % TChunkSlots;
+            if (chunk->control[offset] == HashGroup::DELETED) {
+                m_table->deleted--;
+            }
+            std::construct_at(chunk->nodes + offset, hash_code, key, std::forward<TArgs>(args)...);
+            chunk->control[offset] = HashGroup::tag(hash_code);
+            m_table->count++;
+
+            return chunk->nodes[offset];
+        }
+
+        // A slot goes straight back to EMPTY when its group already holds an
+        // EMPTY slot, since every probe reaching that group stops there.
+        template<typename TLookup>
+        inline void remove_node(const TLookup& key) {
+            std::uint32_t index = locate(m_table, key, THash::hash_code(key));
+            assert(index != m_table->capacity);
+
+            own_table();
+            Chunk* chunk = own_chunk(index / TChunkSlots);
+            std::uint32_t offset = index % TChunkSlots;
+            std::destroy_at(chunk->nodes + offset);
+            if (HashGroup(chunk->control + offset / HashGroup::WIDTH * HashGroup::WIDTH).match_empty()) {
+                chunk->control[offset] = HashGroup::EMPTY;
+            }
+            else {
+                chunk->control[offset] = HashGroup::DELETED;
+                m_table->deleted++;
+            }
+            m_table->count--;
+        }
+
+        // Nodes are moved out of chunks only the map holds and copied out of
+        // chunks a snapshot shares. Hash codes are reused.
+        inline void rehash(std::uint32_t capacity) {
+            Table* table = new_table(capacity);
+            table->count = m_table->count;
+            for (std::uint32_t i = 0; i < m_table->capacity / TChunkSlots; i++) {
+                Chunk* chunk = m_table->chunks[i];
+                bool owned = chunk->references.load(std::memory_order_acquire) == 1;
+                for (std::uint32_t j = 0; j < TChunkSlots; j++) {
+                    if (chunk->control[j] < 0) {
+                        continue;
+                    }
+                    Node& node = chunk->nodes[j];
+                    std::uint32_t index = find_empty_index(table, node.get_hash_code());
+                    Chunk* target = table->chunks[index / TChunkSlots];
+                    if (owned) {
+                        std::construct_at(target->nodes + index % TChunkSlots, std::move(node));
+                    }
+                    else {
+                        std::construct_at(target->nodes + index % TChunkSlots, node.get_hash_code(), node.get_key(), node.get_value());
+                    }
+                    target->control[index % TChunkSlots] = chunk->control[j];
+                }
+            }
+            release_table(m_table);
+            m_table = table;
+        }
+
+    private:
+        Table* m_table;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <assert.h>
+#include "hash_map.h"
+#include "vector.h"
+
+namespace ccnt {
+    // Copies strings into blocks of BLOCK_SIZE bytes that are never moved or
+    // freed before the arena is cleared, so the views it returns stay valid.
+    // A string longer than a block gets a block of its own.
+    template<typename TAllocator = std::allocator<char>>
+    class StringArena {
+    public:
+        static constexpr std::uint32_t BLOCK_SIZE = 64 * 1024;
+
+    private:
+        struct Block {
+            char* data;
+            std::uint32_t size;
+        };
+
+    public:
+        StringArena() : m_next(nullptr), m_left(0), m_size(0) {
+        }
+
+        StringArena(StringArena&& string_arena) : m_blocks(std::move(string_arena.m_blocks)), m_next(string_arena.m_next), m_left(string_arena.m_left), m_size(string_arena.m_size), m_allocator(string_arena.m_allocator) {
+            string_arena.m_next = nullptr;
+            string_arena.m_left = 0;
+            string_arena.m_size = 0;
+        }
+
+        ~StringArena() {
+            clear();
+        }
+
+        inline std::string_view store(std::string_view string) {
+            std::uint32_t size = static_cast<std::uint32_t>(string.size());
+            if (size == 0) {
+                return std::string_view();
+            }
+            if (size > m_left) {
+                std::uint32_t block_size = std::max(size, BLOCK_SIZE);
+                m_next = m_allocator.allocate(block_size);
+                m_left = block_size;
+                m_blocks.push_back({ m_next, block_size });
+            }
+            char* data = m_next;
+            std::memcpy(data, string.data(), size);
+            m_next += size;
+            m_left -= size;
+            m_size += size;
+
+            return std::string_view(data, size);
+        }
+
+        inline void clear() {
+            for (std::uint32_t i = 0; i < m_blocks.get_count(); i++) {
+                m_allocator.deallocate(m_blocks[i].data, m_blocks[i].size);
+            }
+            m_blocks.clear();
+            m_next = nullptr;
+            m_left = 0;
+            m_size = 0;
+        }
+
+        // The bytes of every string stored, not counting the unused tails
+        // of blocks.
+        inline std::uint64_t get_size() const {
+            return m_size;
+        }
+
+        StringArena(const StringArena&) = delete;
+        StringArena& operator = (const StringArena&) = delete;
+
+    private:
+        Vector<Block> m_blocks;
+        char* m_next;
+        std::uint32_t m_left;
+        std::uint64_t m_size;
+        TAllocator m_allocator;
+    };
+
+    // Maps every distinct string to a 32-bit handle, so strings that are
+    // compared and hashed over and over can be compared and hashed as
+    // integers. Handles are dense, starting at 0, and stay valid until the
+    // interner is cleared. Each string is copied once into an arena; the
+    // HashMap that dedupes them is keyed by views into it and can be searched
+    // with anything convertible to std::string_view.
+    template<typename THashIndex = DivisionHashIndex, typename TAllocator = std::allocator<char>>
+    class StringInterner {
+    public:
+        using Handle = std::uint32_t;
+        using Map    = HashMap<std::string_view, Handle, THashIndex, std::allocator<HashNode<std::string_view, Handle>>, HashCode<std::string_view>>;
+
+    public:
+        StringInterner() = default;
+
+        explicit StringInterner(std::uint32_t capacity) : m_map(capacity), m_strings(std::max(capacity, 1u)) {
+        }
+
+        StringInterner(StringInterner&& string_interner) : m_map(std::move(string_interner.m_map)), m_strings(std::move(string_interner.m_strings)), m_arena(std::move(string_interner.m_arena)) {
+        }
+
+        ~StringInterner() = default;
+
+        // Returns the handle of string, storing it first if it is new. The
+        // string is hashed and probed for once; it is copied into the arena
+        // only when the probe finds a free slot.
+        inline Handle intern(std::string_view string) {
+            auto it = m_map.try_emplace_with(string, [&](std::string_view key) {
+                std::string_view stored = m_arena.store(key);
+                m_strings.push_back(stored);
+                return stored;
+            }, m_strings.get_count()).first;
+
+            return (*it).get_value();
+        }
+
+        // Looks string up without storing it.
+        inline bool find(std::string_view string, Handle& handle) const {
+            auto it = m_map.find(string);
+            if (it == m_map.cend()) {
+                return false;
+            }
+            handle = (*it).get_value();
+
+            return true;
+        }
+
+        inline bool contains(std::string_view string) const {
+            return m_map.contains(string);
+        }
+
+        inline std::string_view get_string(Handle handle) const {
+            return m_strings[handle];
+        }
+
+        inline std::string_view operator [] (Handle handle) const {
+            return m_strings[handle];
+        }
+
+        inline StringInterner& operator = (StringInterner&& string_interner) {
+            if (this != &string_interner) {
+                std::destroy_at(this);
+                std::construct_at(this, std::move(string_interner));
+            }
+
+            return *this;
+        }
+
+        // Invalidates every handle and view handed out.
+        inline void clear() {
+            m_map.clear();
+            m_strings.clear();
+            m_arena.clear();
+        }
+
+        inline std::uint32_t get_count() const {
+            return m_strings.get_count();
+        }
+
+        inline std::uint64_t get_arena_size() const {
+            return m_arena.get_size();
+        }
+
+        StringInterner(const StringInterner&) = delete;
+        StringInterner& operator = (const StringInterner&) = delete;
+
+    private:
+        Map m_map;
+        Vector<std::string_view> m_strings;
+        StringArena<TAllocator> m_arena;
+    };
+}